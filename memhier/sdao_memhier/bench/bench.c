@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "cache.h"
+#include "config.h"
+#include "hierarchy.h"
+#include "ptable.h"
+#include "tlb.h"
+#include "tracegen.h"
+
+// Throughput of the simulator's hot paths in references per second, one CSV record per
+// benchmark, geometry and access pattern. Traces are generated in memory up front and every
+// repeat builds a fresh structure, so only the references themselves are timed.
+
+#define BENCH_DEFAULT_REFERENCES 1000000lu
+#define BENCH_DEFAULT_REPEATS    3lu
+#define BENCH_FOOTPRINT          0x1000000lu   // bytes touched by every pattern
+#define BENCH_PAGE_SIZE          4096lu
+#define BENCH_PPAGES             1024lu        // a quarter of the footprint fits in memory
+
+typedef struct BenchTrace BenchTrace;
+typedef struct BenchCache BenchCache;
+typedef struct BenchTLB BenchTLB;
+typedef struct BenchPTable BenchPTable;
+typedef struct BenchHierarchy BenchHierarchy;
+typedef struct Benchmark Benchmark;
+
+struct BenchTrace {
+  const char* pattern;
+  const char* spec;
+  uint64_t* addresses;
+  bool* writes;
+};
+
+struct BenchCache {
+  size_t num_sets;
+  size_t set_size;
+  size_t line_size;
+};
+
+struct BenchTLB {
+  size_t num_sets;
+  size_t set_size;
+};
+
+struct BenchPTable {
+  PageTableType type;
+  PageReplacementPolicy replacement;
+};
+
+// end to end configurations, virtual ones put a TLB and page table in front
+struct BenchHierarchy {
+  const char* name;
+  bool virtual_addresses;
+  bool use_L2;
+  bool classify;
+};
+
+// times one run over `count` references of `trace`, `param` points at the geometry
+struct Benchmark {
+  const char* name;
+  double (*run)(const void* param, const BenchTrace* trace, const size_t count);
+  void (*geometry)(const void* param, char* buf, const size_t size);
+  const void* params;
+  size_t param_size;
+  size_t num_params;
+};
+
+static BenchTrace bench_traces[] = {
+  {"sequential", "sequential", NULL, NULL},
+  {"strided", "strided,stride=4096", NULL, NULL},
+  {"uniform", "uniform", NULL, NULL},
+  {"zipf", "zipf", NULL, NULL},
+  {"chase", "chase", NULL, NULL},
+};
+
+static const BenchCache bench_caches[] = {
+  {64, 1, 32},
+  {64, 4, 64},
+  {512, 8, 64},
+  {8192, 8, 64},
+};
+
+static const BenchTLB bench_tlbs[] = {
+  {16, 4},
+  {64, 8},
+};
+
+static const BenchPTable bench_ptables[] = {
+  {PTABLE_FLAT, PAGE_LRU},
+  {PTABLE_FLAT, PAGE_CLOCK},
+  {PTABLE_RADIX, PAGE_LRU},
+  {PTABLE_HASHED, PAGE_LRU},
+};
+
+static const BenchHierarchy bench_hierarchies[] = {
+  {"dc", false, false, false},
+  {"dc+L2", false, true, false},
+  {"tlb+pt+dc+L2", true, true, false},
+  {"tlb+pt+dc+L2+3C", true, true, true},
+};
+
+static double _bench_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+// CACHES
+
+static double _bench_cache(const BenchCache* geometry, const BenchTrace* trace, const size_t count, const bool write) {
+  Cache* cache = cache_new(geometry->num_sets, geometry->set_size, geometry->line_size, WRITE_BACK, WRALLOC, REPLACE_LRU);
+
+  double start = _bench_now();
+  if (write) {
+    for (size_t i = 0; i < count; i++)
+      cache_write(cache, (uint32_t) trace->addresses[i], true);
+  } else {
+    for (size_t i = 0; i < count; i++)
+      cache_read(cache, (uint32_t) trace->addresses[i]);
+  }
+  double seconds = _bench_now() - start;
+
+  cache_free(cache);
+  return seconds;
+}
+
+static double _bench_cache_read(const void* param, const BenchTrace* trace, const size_t count) {
+  return _bench_cache(param, trace, count, false);
+}
+
+static double _bench_cache_write(const void* param, const BenchTrace* trace, const size_t count) {
+  return _bench_cache(param, trace, count, true);
+}
+
+static void _bench_cache_geometry(const void* param, char* buf, const size_t size) {
+  const BenchCache* geometry = param;
+  snprintf(buf, size, "%lux%lux%lu", geometry->num_sets, geometry->set_size, geometry->line_size);
+}
+
+// TRANSLATION
+
+static PTable* _bench_new_ptable(const PageTableType type, const PageReplacementPolicy replacement) {
+  return ptable_new(BENCH_FOOTPRINT / BENCH_PAGE_SIZE, BENCH_PPAGES, BENCH_PAGE_SIZE, type, 32, replacement);
+}
+
+// misses walk a flat LRU page table, so this times both
+static double _bench_tlb(const void* param, const BenchTrace* trace, const size_t count) {
+  const BenchTLB* geometry = param;
+  PTable* ptable = _bench_new_ptable(PTABLE_FLAT, PAGE_LRU);
+  TLB* tlb = TLB_new(ptable, geometry->num_sets, geometry->set_size, BENCH_PAGE_SIZE, REPLACE_LRU);
+  ptable_connect_tlb(ptable, tlb);
+  uint32_t sum = 0;
+
+  double start = _bench_now();
+  for (size_t i = 0; i < count; i++)
+    sum += TLB_virt_phys(tlb, trace->addresses[i], trace->writes[i]);
+  double seconds = _bench_now() - start;
+
+  TLB_free(tlb);
+  ptable_free(ptable);
+
+  // keeps the translations from being thrown away
+  if (sum == 1) fputc('\0', stderr);
+  return seconds;
+}
+
+static void _bench_tlb_geometry(const void* param, char* buf, const size_t size) {
+  const BenchTLB* geometry = param;
+  snprintf(buf, size, "%lux%lu", geometry->num_sets, geometry->set_size);
+}
+
+static double _bench_ptable(const void* param, const BenchTrace* trace, const size_t count) {
+  const BenchPTable* geometry = param;
+  PTable* ptable = _bench_new_ptable(geometry->type, geometry->replacement);
+  uint32_t sum = 0;
+
+  double start = _bench_now();
+  for (size_t i = 0; i < count; i++)
+    sum += ptable_virt_phys(ptable, trace->addresses[i], trace->writes[i]);
+  double seconds = _bench_now() - start;
+
+  ptable_free(ptable);
+
+  if (sum == 1) fputc('\0', stderr);
+  return seconds;
+}
+
+static void _bench_ptable_geometry(const void* param, char* buf, const size_t size) {
+  const BenchPTable* geometry = param;
+  const char* replacement = geometry->replacement == PAGE_CLOCK ? "clock" : geometry->replacement == PAGE_SECOND_CHANCE ? "second-chance" : "lru";
+  snprintf(buf, size, "%s/%s", page_table_type_name(geometry->type), replacement);
+}
+
+// END TO END
+
+// the defaults read_config gives, with a 4 way 16KB dc and an 8 way 256KB L2
+static void _bench_config(const BenchHierarchy* geometry, Config* config) {
+  memset(config, 0, sizeof(Config));
+
+  config->tlb_num_sets = 16;
+  config->tlb_set_size = 4;
+  config->pt_num_vpages = BENCH_FOOTPRINT / BENCH_PAGE_SIZE;
+  config->pt_num_ppages = BENCH_PPAGES;
+  // physical addresses have to cover the footprint
+  config->pt_page_size = geometry->virtual_addresses ? BENCH_PAGE_SIZE : BENCH_FOOTPRINT / BENCH_PPAGES;
+
+  config->dc_num_sets = 64;
+  config->dc_set_size = 4;
+  config->dc_line_size = 64;
+  config->L2_num_sets = 512;
+  config->L2_set_size = 8;
+  config->L2_line_size = 64;
+
+  config->virtual_addresses = geometry->virtual_addresses;
+  config->use_tlb = geometry->virtual_addresses;
+  config->use_L2 = geometry->use_L2;
+  config->dc_prefetch_degree = config->L2_prefetch_degree = 1;
+  config->cores = 1;
+  config->dc_classify = geometry->classify;
+  config->L2_classify = geometry->classify && geometry->use_L2;
+}
+
+static double _bench_hierarchy(const void* param, const BenchTrace* trace, const size_t count) {
+  Config config;
+  _bench_config(param, &config);
+
+  Hierarchy* hierarchy = hierarchy_new(&config);
+  if (!hierarchy) exit(1);
+  uint32_t paddress;
+
+  double start = _bench_now();
+  for (size_t i = 0; i < count; i++)
+    hierarchy_access(hierarchy, 0, trace->writes[i] ? TRACE_WRITE : TRACE_READ, trace->addresses[i], &paddress);
+  double seconds = _bench_now() - start;
+
+  hierarchy_free(hierarchy);
+  return seconds;
+}
+
+static void _bench_hierarchy_geometry(const void* param, char* buf, const size_t size) {
+  const BenchHierarchy* geometry = param;
+  snprintf(buf, size, "%s", geometry->name);
+}
+
+#define BENCH_PARAMS(array) array, sizeof(array[0]), sizeof(array) / sizeof(array[0])
+
+static const Benchmark benchmarks[] = {
+  {"cache_read", _bench_cache_read, _bench_cache_geometry, BENCH_PARAMS(bench_caches)},
+  {"cache_write", _bench_cache_write, _bench_cache_geometry, BENCH_PARAMS(bench_caches)},
+  {"TLB_virt_phys", _bench_tlb, _bench_tlb_geometry, BENCH_PARAMS(bench_tlbs)},
+  {"ptable_virt_phys", _bench_ptable, _bench_ptable_geometry, BENCH_PARAMS(bench_ptables)},
+  {"hierarchy", _bench_hierarchy, _bench_hierarchy_geometry, BENCH_PARAMS(bench_hierarchies)},
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+#define NUM_TRACES (sizeof(bench_traces) / sizeof(bench_traces[0]))
+
+void print_usage(const char* name) {
+  fprintf(stderr, "Usage: %s [-n references] [-r repeats] [benchmark...]\n\n", name);
+  fprintf(stderr, "  -n <n>  references per run (default %lu)\n", BENCH_DEFAULT_REFERENCES);
+  fprintf(stderr, "  -r <n>  runs per record, the fastest one is reported (default %lu)\n", BENCH_DEFAULT_REPEATS);
+  fprintf(stderr, "  benchmarks are");
+  for (size_t i = 0; i < NUM_BENCHMARKS; i++)
+    fprintf(stderr, " %s", benchmarks[i].name);
+  fprintf(stderr, ", all of them when none are given\n");
+}
+
+// whether benchmark `name` was asked for
+static bool _bench_selected(const char* name, char* const* names, const size_t num_names) {
+  if (!num_names) return true;
+
+  for (size_t i = 0; i < num_names; i++)
+    if (!strcmp(name, names[i])) return true;
+  return false;
+}
+
+int main(int argc, char** argv) {
+  long references = BENCH_DEFAULT_REFERENCES;
+  long repeats = BENCH_DEFAULT_REPEATS;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+    switch (opt) {
+      case 'n':
+        references = strtol(optarg, NULL, 10);
+        break;
+      case 'r':
+        repeats = strtol(optarg, NULL, 10);
+        break;
+      default:
+        print_usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (references < 1 || repeats < 1) {
+    fprintf(stderr, "Expected a positive number of references and repeats.\n");
+    return 1;
+  }
+
+  for (int i = optind; i < argc; i++) {
+    bool known = false;
+    for (size_t j = 0; j < NUM_BENCHMARKS; j++)
+      known = known || !strcmp(argv[i], benchmarks[j].name);
+
+    if (!known) {
+      fprintf(stderr, "Unknown benchmark \"%s\".\n", argv[i]);
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  // every benchmark sees the same references
+  for (size_t i = 0; i < NUM_TRACES; i++) {
+    BenchTrace* trace = bench_traces + i;
+    TraceGenSpec spec;
+    char spec_str[128];
+
+    snprintf(spec_str, sizeof(spec_str), "%s,count=%ld,footprint=%lu,writes=0.3", trace->spec, references, BENCH_FOOTPRINT);
+    trace->addresses = malloc(sizeof(uint64_t) * references);
+    trace->writes = malloc(sizeof(bool) * references);
+    if (!trace->addresses || !trace->writes || !tracegen_parse(spec_str, &spec) || !tracegen_fill(&spec, trace->addresses, trace->writes)) {
+      fprintf(stderr, "Failed to generate the %s trace.\n", trace->pattern);
+      return 1;
+    }
+  }
+
+  printf("benchmark,geometry,pattern,references,seconds,refs_per_sec\n");
+  for (size_t b = 0; b < NUM_BENCHMARKS; b++) {
+    const Benchmark* benchmark = benchmarks + b;
+    if (!_bench_selected(benchmark->name, argv + optind, argc - optind)) continue;
+
+    for (size_t p = 0; p < benchmark->num_params; p++) {
+      const void* param = (const char*) benchmark->params + p * benchmark->param_size;
+      char geometry[64];
+      benchmark->geometry(param, geometry, sizeof(geometry));
+
+      for (size_t t = 0; t < NUM_TRACES; t++) {
+        double best = 0;
+        for (long r = 0; r < repeats; r++) {
+          double seconds = benchmark->run(param, bench_traces + t, references);
+          if (!r || seconds < best) best = seconds;
+        }
+
+        printf("%s,%s,%s,%ld,%.6f,%.0f\n", benchmark->name, geometry, bench_traces[t].pattern, references, best, best > 0 ? references / best : 0);
+        fflush(stdout);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < NUM_TRACES; i++) {
+    free(bench_traces[i].addresses);
+    free(bench_traces[i].writes);
+  }
+
+  return 0;
+}
@@ -2,6 +2,13 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
+
+#include "classify.h"
+#include "mshr.h"
+#include "prefetch.h"
+#include "replace.h"
+#include "victim.h"
 
 
 enum WritePolicy {
@@ -16,9 +23,25 @@ enum AccessType {
   CACHE_READ, CACHE_WRITE
 };
 
+// snooping protocol between the caches sharing a next level
+enum CoherenceProtocol {
+  COHERENCE_NONE,
+  COHERENCE_MESI,   // a dirty line is written back when another cache reads it
+  COHERENCE_MOESI   // a dirty line read by another cache stays dirty in its owner (O) and is shared from there
+};
+
+// what a level keeps of the lines held by the levels above it
+enum InclusionPolicy {
+  INCLUSION_INCLUSIVE,  // holds every line above it, evictions back-invalidate the levels above
+  INCLUSION_NINE,       // fills on the way up like an inclusive cache, but evictions leave the levels above alone
+  INCLUSION_EXCLUSIVE   // only holds what the levels above evicted, a hit moves the line up
+};
+
 typedef enum WritePolicy WritePolicy;
 typedef enum WriteMissPolicy WriteMissPolicy;
 typedef enum AccessType AccessType;
+typedef enum CoherenceProtocol CoherenceProtocol;
+typedef enum InclusionPolicy InclusionPolicy;
 
 struct CacheStats {
   uint32_t address;
@@ -26,6 +49,7 @@ struct CacheStats {
   uint32_t index;
   bool hit;
   bool show;
+  bool buffered;    // the miss was served beside the cache (victim cache, stream buffer), the next level never saw it
 
   AccessType type;
 
@@ -33,23 +57,139 @@ struct CacheStats {
   size_t reads;
   size_t mem_accesses;
   size_t total_accesses;
+  size_t back_invalidations;  // lines above invalidated by this cache's evictions (inclusive)
+  size_t victim_fills;        // lines the levels above evicted into this cache (exclusive)
   char name[10];
 };
 
+// prefetch counters, kept when the cache has a prefetcher
+struct PrefetchStats {
+  size_t issued;      // lines fetched from the next level by the prefetcher
+  size_t useful;      // prefetched lines a demand access used
+  size_t unused;      // prefetched lines evicted, invalidated or dropped before any use
+  size_t late;        // useful prefetches used within PREFETCH_LATE_DISTANCE accesses of being issued
+  uint64_t lead;      // accesses between issue and first use, summed over the useful prefetches
+  size_t pollution;   // demand misses on lines a prefetch fill had evicted
+  size_t misses;      // demand misses left over for the next level
+};
+
+// victim cache counters, kept when the cache has one
+struct VictimStats {
+  size_t probes;      // misses that looked in the victim cache
+  size_t hits;        // misses the victim cache served
+  size_t inserts;     // lines evicted into it
+  size_t writebacks;  // dirty lines it pushed out to the next level
+};
+
+// MSHR counters, kept when the cache has them
+struct MSHRStats {
+  size_t primary;     // misses that went to the next level and took an entry
+  size_t merged;      // references to a line that still had a miss outstanding
+  size_t stalls;      // primary misses that found every entry busy
+  size_t peak;        // most misses outstanding at once
+};
+
+// coherence counters, kept when the cache is coherent
+struct CoherenceStats {
+  size_t coherence_misses;  // misses on lines another cache's write had invalidated here
+  size_t invalidations;     // lines invalidated here by another cache's write
+  size_t upgrades;          // write hits on shared lines, which invalidate the other copies
+  size_t transfers;         // misses another cache supplied a dirty line for
+};
+
+// 3C miss counters, kept when the cache classifies its misses. they add up to the misses
+struct MissStats {
+  size_t compulsory;
+  size_t capacity;
+  size_t conflict;
+};
+
+// reuse distance histogram, kept when the cache is instrumented. the distance of a hit is how many accesses
+// (writebacks included) the cache saw since the line was last filled or hit, bucket `i` counts distances of
+// 2^(i-1) up to 2^i - 1 (bucket 0 is 0). accesses that find the line missing count in `misses`
+#define CACHE_REUSE_BUCKETS 65
+
+struct ReuseStats {
+  uint64_t histogram[CACHE_REUSE_BUCKETS];
+  uint64_t misses;
+};
+
 typedef struct Cache Cache;
 typedef struct CacheStats CacheStats;
+typedef struct PrefetchStats PrefetchStats;
+typedef struct VictimStats VictimStats;
+typedef struct MSHRStats MSHRStats;
+typedef struct CoherenceStats CoherenceStats;
+typedef struct MissStats MissStats;
+typedef struct ReuseStats ReuseStats;
 
-Cache* cache_new(const size_t num_sets, const size_t set_size, const size_t line_size, const WritePolicy write_policy, WriteMissPolicy write_miss_policy);
+Cache* cache_new(const size_t num_sets, const size_t set_size, const size_t line_size, const WritePolicy write_policy, WriteMissPolicy write_miss_policy, const ReplacementPolicy replacement);
 
 void cache_write(Cache* cache, const uint32_t address, bool update_lru);
-void cache_read(Cache* cache, const uint32_t address);
+// returns whether the line handed up is dirty, which only happens for an exclusive cache
+bool cache_read(Cache* cache, const uint32_t address);
 void cache_invalidate_all(Cache* cache);
+// zeroes every counter (stats, prefetch, victim cache, MSHR, coherence, 3C, reuse and per set), the contents stay
+void cache_reset_stats(Cache* cache);
 void cache_invalidate_entry(Cache* cache, const uint32_t address);
 void cache_free(Cache* cache);
+// `next` can be shared by several caches, each of them is invalidated when `next` evicts a line
 void cache_connect(Cache* prev, Cache* next);
 
 void cache_decode_debug(const Cache* cache, const char* cache_name);
 CacheStats* cache_stats(const Cache* cache);
 
-void cache_invalidate_range(Cache* cache, const uint32_t low_addr, const uint32_t high_addr);
+// returns how many lines were invalidated, here and in the levels above
+size_t cache_invalidate_range(Cache* cache, const uint32_t low_addr, const uint32_t high_addr);
+
+// every access adds `latency` to `*cycles`. `memory_latency` is added for every memory access when this is the last level.
+// misses served by the victim cache or a stream buffer take `latency` again, prefetches are free.
+void cache_set_timing(Cache* cache, uint64_t* cycles, const size_t latency, const size_t memory_latency);
+
+// attaches a prefetcher fetching `degree` lines ahead (at most PREFETCH_MAX_DEGREE)
+void cache_set_prefetcher(Cache* cache, const PrefetchPolicy policy, const size_t degree);
+PrefetchStats* cache_prefetch_stats(const Cache* cache);
+
+// attaches a fully associative victim cache of `entries` lines (at most VICTIM_MAX_ENTRIES)
+void cache_set_victim(Cache* cache, const size_t entries);
+VictimStats* cache_victim_stats(const Cache* cache);
+
+// attaches `entries` MSHRs (at most MSHR_MAX_ENTRIES), each miss stays outstanding for `miss_time` accesses
+void cache_set_mshrs(Cache* cache, const size_t entries, const uint64_t miss_time);
+MSHRStats* cache_mshr_stats(const Cache* cache);
+
+// keeps the cache coherent with the other coherent caches connected to the same next level
+void cache_set_coherence(Cache* cache, const CoherenceProtocol protocol);
+CoherenceStats* cache_coherence_stats(const Cache* cache);
+
+// classifies every miss as compulsory, capacity or conflict against a fully associative LRU cache of as many lines
+void cache_set_classify(Cache* cache, const bool classify);
+MissStats* cache_miss_stats(const Cache* cache);
+
+// keeps the reuse distance histogram, its storage is allocated with the cache so this only switches it on
+void cache_set_instrument(Cache* cache, const bool instrument);
+ReuseStats* cache_reuse_stats(const Cache* cache);
+
+// the number of sets the cache is configured with, sampled or not
+size_t cache_num_sets(const Cache* cache);
+// the accesses and misses of set `index` so far, returns false when sampling or partitioning left the set out
+bool cache_set_counts(const Cache* cache, const uint32_t index, uint64_t* accesses, uint64_t* misses);
+
+bool coherence_protocol_parse(const char* name, CoherenceProtocol* protocol);
+const char* coherence_protocol_name(const CoherenceProtocol protocol);
+
+// how the cache treats the lines of the caches connected above it, inclusive by default
+void cache_set_inclusion(Cache* cache, const InclusionPolicy inclusion);
+
+bool inclusion_policy_parse(const char* name, InclusionPolicy* inclusion);
+const char* inclusion_policy_name(const InclusionPolicy inclusion);
+
+// writes or reads everything the cache holds and counts (see snapshot.h), returns false on a short read or write.
+// the cache has to be set up the same way (sampling, prefetcher, victim cache, MSHRs, coherence, 3C,
+// instrumentation) as the one saved
+bool cache_save(const Cache* cache, FILE* f);
+bool cache_load(Cache* cache, FILE* f);
+
+bool cache_sample(Cache* cache, const uint32_t address_mask, const uint32_t address_value);
+double cache_sample_miss_ratio(const Cache* cache, double* half_width);
 
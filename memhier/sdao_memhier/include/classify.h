@@ -0,0 +1,67 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define CLASSIFIER_BLOCK_LINES 65536u   // lines per block of the first touch bitmap
+
+// the 3C kinds of miss
+enum MissClass {
+  MISS_COMPULSORY,  // the first reference to the line
+  MISS_CAPACITY,    // a fully associative LRU cache of the same size would have missed too
+  MISS_CONFLICT     // a fully associative LRU cache of the same size would have hit
+};
+
+typedef enum MissClass MissClass;
+typedef struct MissClassifier MissClassifier;
+typedef struct ClassifierEntry ClassifierEntry;
+typedef struct ClassifierNode ClassifierNode;
+
+struct ClassifierEntry {
+  uint32_t line;
+  uint32_t node;        // node + 1, 0 for an empty entry
+};
+
+struct ClassifierNode {
+  uint32_t line;
+  uint32_t prev;
+  uint32_t next;
+};
+
+// Follows the references of a cache by line number (address / line_size) to classify its misses.
+// Lines referenced so far are bits of a bitmap whose blocks are only allocated once a line in them is.
+// The shadow cache is a fully associative LRU list of `capacity` nodes, found by line through an open
+// addressing table kept at most half full. Both only grow with the cache, not with the trace, and every
+// reference costs a lookup in the table plus a bit test when the shadow cache misses.
+struct MissClassifier {
+  size_t capacity;
+
+  size_t num_blocks;
+  uint64_t** touched;
+
+  size_t table_mask;    // entries - 1, a power of 2 of at least twice the capacity
+  ClassifierEntry* table;
+
+  size_t used;          // nodes handed out so far
+  ClassifierNode* nodes;
+  uint32_t head;        // MRU node
+  uint32_t tail;        // LRU node
+};
+
+// `line_bits` is how many bits line numbers have
+MissClassifier* classifier_new(const size_t capacity, const size_t line_bits);
+void classifier_free(MissClassifier* classifier);
+
+// snapshot state (see snapshot.h), the bitmap blocks in use are saved after a presence byte each
+bool classifier_save(const MissClassifier* classifier, FILE* f);
+bool classifier_load(MissClassifier* classifier, FILE* f);
+
+// references `line`, returns what kind of miss it would be when the cache misses it
+MissClass classifier_access(MissClassifier* classifier, const uint32_t line);
+
+// the same for a reference the cache doesn't fill on, the shadow cache only takes `line` when it holds it already
+MissClass classifier_probe(MissClassifier* classifier, const uint32_t line);
+
+// drops `line` from the shadow cache, for caches that give up a line without evicting it
+void classifier_evict(MissClassifier* classifier, const uint32_t line);
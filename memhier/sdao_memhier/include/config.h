@@ -2,6 +2,24 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+#include "cache.h"
+#include "config_consts.h"
+#include "prefetch.h"
+#include "mshr.h"
+#include "ptable.h"
+#include "replace.h"
+#include "victim.h"
+
+// an optional cache block: the instruction cache or a level below the L2
+typedef struct LevelConfig {
+  size_t num_sets;
+  size_t set_size;
+  size_t line_size;
+  bool   write;                 // TRUE: Write Through, FALSE: No Write Allocate
+  size_t latency;               // cycles per access, 0 when the latency section leaves the level out
+  InclusionPolicy inclusion;    // towards the levels above, inclusive when not given
+} LevelConfig;
+
 typedef struct Config {
   size_t tlb_num_sets;      // TLB Number of sets
   size_t tlb_set_size;      // TLB Set size
@@ -23,6 +41,44 @@ typedef struct Config {
   bool virtual_addresses;   // TRUE: Require Virtual to Physical Translation
   bool use_tlb;             // TRUE: Use TLB, FALSE: Don't use TLB
   bool use_L2;              // TRUE: Use L2 Cache, FALSE: Don't use L2 Cache
+
+  ReplacementPolicy tlb_replacement;  // optional, LRU when not given
+  ReplacementPolicy dc_replacement;   // optional, LRU when not given
+  ReplacementPolicy L2_replacement;   // optional, LRU when not given
+  PageReplacementPolicy pt_replacement; // optional, LRU when not given
+
+  PageTableType pt_type;    // optional, flat when not given
+  size_t pt_address_bits;   // virtual address width of radix and hashed tables
+
+  PrefetchPolicy dc_prefetch;   // optional, none when not given
+  size_t dc_prefetch_degree;    // lines fetched ahead, 1 when not given
+  PrefetchPolicy L2_prefetch;   // optional, none when not given
+  size_t L2_prefetch_degree;    // lines fetched ahead, 1 when not given
+
+  size_t dc_victim_entries;     // optional, 0 (no victim cache) when not given
+  size_t dc_mshr_entries;       // optional, 0 (no MSHRs) when not given
+  size_t dc_mshr_miss_time;     // dc accesses a miss stays outstanding
+
+  bool timing;                  // TRUE: latencies were given, report cycles and AMAT
+  size_t tlb_latency;           // cycles per TLB lookup
+  size_t walk_latency;          // cycles per page table walk
+  size_t dc_latency;            // cycles per dc access
+  size_t L2_latency;            // cycles per L2 access
+  size_t memory_latency;        // cycles per main memory access
+  size_t disk_latency;          // cycles per page read from or written back to disk
+
+  bool use_L1I;                 // optional instruction cache block, fetches go to the dc without one
+  LevelConfig L1I;
+  InclusionPolicy L2_inclusion; // optional, inclusive when not given
+  bool report_inclusion;        // TRUE: an inclusion section was given, print back-invalidations and victim fills
+  size_t num_lower;             // optional blocks for the levels below the L2, L3 first
+  LevelConfig lower[MAX_LEVELS - 2];
+
+  size_t cores;                 // optional, 1 when not given. every core has its own dc in front of the shared L2
+  CoherenceProtocol coherence;  // protocol between the dcs of more than one core
+
+  bool dc_classify;             // optional, TRUE: split the dc misses into compulsory, capacity and conflict ones
+  bool L2_classify;             // optional, the same for the L2
 } Config;
 
 void print_config(const Config* config);
@@ -1,7 +1,15 @@
 #define TLB_MAX_SETS        256lu
 #define DC_MAX_SETS         8192lu
+// can be raised up to 32 at build time with -DMAX_ASSOCIATIVITY=<n>lu
+#ifndef MAX_ASSOCIATIVITY
 #define MAX_ASSOCIATIVITY   8lu
+#endif
 #define NUM_VPAGES_MAX      8192lu
+// frame allocation and replacement don't scan the frames, so this can be raised at build time
+#ifndef NUM_PPAGES_MAX
 #define NUM_PPAGES_MAX      1024lu
-#define MAX_ADDR_LEN        32lu
+#endif
+#define MAX_ADDR_LEN        64lu    // virtual addresses, physical addresses stay 32 bits
 #define MIN_LINE_SIZE       8lu
+#define MAX_CORES           16lu
+#define MAX_LEVELS          6lu     // cache levels, L1 to L6
@@ -0,0 +1,141 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "config.h"
+#include "config_consts.h"
+#include "cache.h"
+#include "ptable.h"
+#include "tlb.h"
+#include "trace.h"
+
+enum HierarchyResult {
+  HIERARCHY_OK,         // the reference was simulated
+  HIERARCHY_REJECTED,   // the address was too large
+  HIERARCHY_SKIPPED,    // the reference was translated but maps to an unsampled set
+  HIERARCHY_BAD_CORE    // the reference names a core the configuration doesn't have
+};
+
+// latency histogram buckets, bucket `i` counts references of 2^(i-1) up to 2^i - 1 cycles (bucket 0 is 0 cycles)
+#define HIERARCHY_LATENCY_BUCKETS 65
+
+// a dc and an L1I per core, the L2 and the levels below it
+#define HIERARCHY_MAX_CACHES (2 * MAX_CORES + MAX_LEVELS - 1)
+
+typedef enum HierarchyResult HierarchyResult;
+typedef struct Hierarchy Hierarchy;
+typedef struct HierarchyCounters HierarchyCounters;
+
+// One simulated memory hierarchy built from a Config:
+// an optional page table and TLB in front of the dc and an optional L2, with an optional L1I beside the dc
+// and optional levels below the L2 (L3 first). with more than one core every core gets its own coherent dc
+// (and L1I) and they share the TLB, the L2 and the levels below it.
+struct Hierarchy {
+  const Config* config;
+
+  PTable* ptable;
+  TLB* tlb;
+  Cache* dcs[MAX_CORES];
+  Cache* L1Is[MAX_CORES];   // NULL without an L1I
+  size_t cores;
+  Cache* L2;
+  Cache* lower[MAX_LEVELS - 2];
+  size_t num_lower;
+
+  // address limit for the current address mode (virtual or physical)
+  uint64_t max_address;
+
+  // references rejected because their address was too large or their core doesn't exist
+  size_t rejected;
+
+  // set sampling and partitioning: only references whose `sample_mask` bits equal `sample_value` reach the caches
+  size_t sample_ratio;
+  uint32_t sample_mask;
+  uint32_t sample_value;
+  size_t skipped;
+
+  // latency model, only kept when the config gives latencies. the TLB, page table and caches add the
+  // cost of what they do to `cycles`, which then goes to the totals of the reference's access type.
+  uint64_t cycles;
+  uint64_t total_cycles[3];     // indexed by TraceAccess
+  size_t timed[3];
+  size_t latency_histogram[3][HIERARCHY_LATENCY_BUCKETS];
+
+  // instruction fetches, they read the L1I (the dc without one)
+  size_t fetches;
+
+  // references handed to hierarchy_access so far. every counter is reset when they reach `warmup` (0 never)
+  size_t references;
+  size_t warmup;
+
+  // per set counts, reuse distances and page faults are kept for hierarchy_write_instrumentation
+  bool instrumented;
+};
+
+// running totals for interval rows, every core's dc (and L1I) and the L2 add up into dc and L2.
+// an interval is the difference of two of these
+struct HierarchyCounters {
+  size_t references;
+  size_t dc_hits;
+  size_t dc_accesses;
+  size_t L2_hits;
+  size_t L2_accesses;
+  size_t tlb_hits;
+  size_t tlb_accesses;
+  size_t pt_faults;
+  size_t memory_refs;
+  size_t disk_refs;
+  uint64_t cycles;
+};
+
+Hierarchy* hierarchy_new(const Config* config);
+void hierarchy_free(Hierarchy* hierarchy);
+
+// only simulate 1 in `ratio` cache sets. returns false if the caches can't be sampled at that ratio
+bool hierarchy_sample(Hierarchy* hierarchy, const size_t ratio);
+
+// only simulate the sets of partition `part` out of `parts`. requires physical addresses.
+// partitions of the same configuration are independent and can be merged afterwards.
+bool hierarchy_partition(Hierarchy* hierarchy, const size_t parts, const size_t part);
+void hierarchy_merge(Hierarchy* into, const Hierarchy* from);
+
+// writes everything the hierarchy holds and counts to a snapshot file (see snapshot.h)
+bool hierarchy_save(const Hierarchy* hierarchy, const char* filename);
+
+// restores a snapshot into a hierarchy that hasn't simulated anything yet.
+// it has to come from the same configuration with the same set sampling
+bool hierarchy_load(Hierarchy* hierarchy, const char* filename);
+
+// keeps per set access and miss counts, reuse distance histograms for every cache and page fault counts per page.
+// has to come before hierarchy_load, a snapshot only loads into a hierarchy instrumented the same way
+void hierarchy_instrument(Hierarchy* hierarchy);
+
+// writes the instrumentation counters as JSON, or as CSV when `filename` ends in ".csv"
+bool hierarchy_write_instrumentation(const Hierarchy* hierarchy, const char* filename);
+
+// the next `references` references only warm the hierarchy up, every counter is reset after them
+void hierarchy_warmup(Hierarchy* hierarchy, const size_t references);
+
+// zeroes every counter of the hierarchy and its structures, what they hold stays
+void hierarchy_reset_stats(Hierarchy* hierarchy);
+
+// counts `references` another partition simulated as skipped, they still count towards the warm-up
+void hierarchy_skip(Hierarchy* hierarchy, size_t references);
+
+// simulates one reference of `core`. stores the translated address in `paddress`
+HierarchyResult hierarchy_access(Hierarchy* hierarchy, const uint32_t core, const TraceAccess access, const uint64_t address, uint32_t* paddress);
+
+// the first level cache `access` goes to on `core`
+Cache* hierarchy_l1(const Hierarchy* hierarchy, const uint32_t core, const TraceAccess access);
+
+// `verbose` (-v) adds the counters memhier_ref doesn't have
+void hierarchy_print_stats(const Hierarchy* hierarchy, const bool verbose);
+void hierarchy_print_csv_header(FILE* f);
+void hierarchy_print_csv(const Hierarchy* hierarchy, const char* name, FILE* f);
+
+void hierarchy_counters(const Hierarchy* hierarchy, HierarchyCounters* counters);
+void hierarchy_print_interval_header(FILE* f);
+// prints what happened between `last` and `now` as one CSV record
+void hierarchy_print_interval(const HierarchyCounters* now, const HierarchyCounters* last, FILE* f);
@@ -0,0 +1,35 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define MSHR_MAX_ENTRIES 32u
+
+typedef struct MSHRFile MSHRFile;
+
+// Miss status holding registers. Each primary miss holds an entry for `miss_time` accesses to the cache,
+// later references to the same line in that window merge into it instead of being misses of their own.
+// Time is counted in demand accesses to the cache that owns the file.
+struct MSHRFile {
+  size_t entries;
+  uint64_t miss_time;
+  size_t count;               // outstanding misses, kept in the first `count` entries
+  uint32_t lines[MSHR_MAX_ENTRIES];
+  uint64_t done[MSHR_MAX_ENTRIES];  // when each miss gets its line
+};
+
+MSHRFile* mshr_new(const size_t entries, const uint64_t miss_time);
+void mshr_free(MSHRFile* mshr);
+void mshr_reset(MSHRFile* mshr);
+
+// snapshot state (see snapshot.h), the outstanding misses
+bool mshr_save(const MSHRFile* mshr, FILE* f);
+bool mshr_load(MSHRFile* mshr, FILE* f);
+
+// whether `line` has a miss outstanding at `now`
+bool mshr_pending(MSHRFile* mshr, const uint32_t line, const uint64_t now);
+
+// holds an entry for a primary miss to `line` at `now`. returns false when every entry was busy,
+// the miss then waits for the oldest one to finish and takes it over.
+bool mshr_allocate(MSHRFile* mshr, const uint32_t line, const uint64_t now);
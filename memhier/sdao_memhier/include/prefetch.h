@@ -0,0 +1,72 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+enum PrefetchPolicy {
+  PREFETCH_NONE,
+  PREFETCH_NEXT_LINE,   // tagged next-line, the next `degree` lines on a miss or the first hit on a prefetched line
+  PREFETCH_STRIDE,      // PC-less stride table indexed by memory region
+  PREFETCH_STREAM       // stream buffers holding the `degree` lines after a miss, outside the cache
+};
+
+#define PREFETCH_MAX_DEGREE       16u
+#define PREFETCH_STRIDE_ENTRIES   64u   // regions tracked by the stride table
+#define PREFETCH_REGION_BITS      12u   // log2 of a stride table region in bytes
+#define PREFETCH_STRIDE_CONFIDENT 2u    // matching strides seen before the table starts prefetching
+#define PREFETCH_STREAM_BUFFERS   4u
+#define PREFETCH_LATE_DISTANCE    4u    // a prefetch used sooner than this many accesses likely arrived late
+
+typedef enum PrefetchPolicy PrefetchPolicy;
+typedef struct StrideEntry StrideEntry;
+typedef struct StreamBuffer StreamBuffer;
+typedef struct Prefetcher Prefetcher;
+
+struct StrideEntry {
+  uint32_t region;
+  uint32_t last_line;
+  int32_t stride;
+  uint8_t confidence;
+  bool valid;
+};
+
+// a FIFO of prefetched lines, `first` is the head of the ring
+struct StreamBuffer {
+  uint32_t lines[PREFETCH_MAX_DEGREE];
+  uint64_t times[PREFETCH_MAX_DEGREE];  // when each line was fetched
+  size_t first;
+  size_t count;
+  uint64_t last_use;
+};
+
+// Prefetchers work on line numbers (address / line_size) and only decide what to fetch,
+// the cache does the fetching and keeps the statistics.
+struct Prefetcher {
+  PrefetchPolicy policy;
+  size_t degree;
+  size_t line_bits;
+
+  StrideEntry* table;
+  StreamBuffer buffers[PREFETCH_STREAM_BUFFERS];
+};
+
+Prefetcher* prefetcher_new(const PrefetchPolicy policy, const size_t degree, const size_t line_size);
+void prefetcher_free(Prefetcher* prefetcher);
+void prefetcher_reset(Prefetcher* prefetcher);
+
+// snapshot state (see snapshot.h), the stride table and the stream buffers
+bool prefetcher_save(const Prefetcher* prefetcher, FILE* f);
+bool prefetcher_load(Prefetcher* prefetcher, FILE* f);
+
+// trains on a demand access to `line` and stores the lines to prefetch in `lines`, returns how many.
+// `trigger` is set for a miss or the first hit on a prefetched line.
+// stream buffers only allocate on a miss, `dropped` gets the unused lines of the buffer that was replaced.
+size_t prefetcher_access(Prefetcher* prefetcher, const uint32_t line, const bool trigger, const uint64_t now, uint32_t* lines, size_t* dropped);
+
+// stream buffers: whether the head of a buffer holds `line`. the head is consumed, `fetched` gets the time
+// it was fetched and `refill` the line the buffer fetches next.
+bool prefetcher_stream_take(Prefetcher* prefetcher, const uint32_t line, const uint64_t now, uint64_t* fetched, uint32_t* refill);
+
+bool prefetch_policy_parse(const char* name, PrefetchPolicy* policy);
+const char* prefetch_policy_name(const PrefetchPolicy policy);
@@ -2,17 +2,30 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #include "cache.h"
+#include "replace.h"
 
+// how virtual pages are looked up
+enum PageTableType {
+  PTABLE_FLAT,      // one entry per virtual page, allocated up front
+  PTABLE_RADIX,     // 4 level radix tree (x86-64 style), nodes allocated on first touch
+  PTABLE_HASHED     // inverted table, a hash of the virtual page chains the frames holding it
+};
+
+#define PTABLE_RADIX_LEVELS 4
+
+typedef enum PageTableType PageTableType;
 typedef struct PTableEntry PTableEntry;
 typedef struct PTable PTable;
 typedef struct PTableStats PTableStats;
+typedef struct PageFaults PageFaults;
 
 #include "tlb.h"
 
 struct PTableStats {
-  uint32_t vpage;
+  uint64_t vpage;
   uint32_t ppage;
   uint32_t offset;
   bool hit;
@@ -20,12 +33,45 @@ struct PTableStats {
   size_t hits;
   size_t total_accesses;
   size_t disk_accesses;
+
+  size_t table_bytes;   // memory held by the virtual to physical lookup structure
+};
+
+// fault count of one virtual page, kept when the page table is instrumented
+struct PageFaults {
+  uint64_t vpage;
+  uint64_t faults;      // 0 for an unused entry
 };
 
-PTable* ptable_new(size_t virtual_pages, size_t physical_pages, size_t page_size);
+// radix and hashed tables track the faults of up to this many pages per frame, a flat table every page
+#define PTABLE_FAULT_PAGES_PER_FRAME 8
+
+// `address_bits` is the virtual address width of the radix and hashed tables, the flat table covers `virtual_pages`
+PTable* ptable_new(size_t virtual_pages, size_t physical_pages, size_t page_size, const PageTableType type, const size_t address_bits, const PageReplacementPolicy replacement);
 void ptable_connect_tlb(PTable* ptable, TLB* tlb);
 void ptable_connect_cache(PTable* ptable, Cache* cache);
 
 void ptable_free(PTable* ptable);
 PTableStats* ptable_stats(const PTable* ptable);
-uint32_t ptable_virt_phys(PTable* ptable, const uint32_t address, bool write);
+// zeroes the counters, the mappings (and the table size) stay
+void ptable_reset_stats(PTable* ptable);
+size_t ptable_num_ppages(const PTable* ptable);
+// snapshot state (see snapshot.h): the lookup structure, the frames and their replacement order, the stats
+// (and fault counters when instrumented).
+// a radix table only loads into a fresh table
+bool ptable_save(const PTable* ptable, FILE* f);
+bool ptable_load(PTable* ptable, FILE* f);
+
+// counts the faults of every page, the counters are allocated with the table so this only switches them on
+void ptable_set_instrument(PTable* ptable, const bool instrument);
+// the fault counter table, `size` entries in no particular order (unused ones have 0 faults). `untracked` gets
+// the faults of pages that came after the table was full
+const PageFaults* ptable_page_faults(const PTable* ptable, size_t* size, uint64_t* untracked);
+
+uint32_t ptable_virt_phys(PTable* ptable, const uint64_t address, bool write);
+
+// every walk adds `walk_latency` to `*cycles` and every page read or written back `disk_latency`
+void ptable_set_timing(PTable* ptable, uint64_t* cycles, const size_t walk_latency, const size_t disk_latency);
+
+bool page_table_type_parse(const char* name, PageTableType* type);
+const char* page_table_type_name(const PageTableType type);
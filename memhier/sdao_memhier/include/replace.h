@@ -0,0 +1,62 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+enum ReplacementPolicy {
+  REPLACE_LRU,      // true LRU, recency ranks per way
+  REPLACE_PLRU,     // tree pseudo-LRU, set_size - 1 bits per set
+  REPLACE_SRRIP,    // static RRIP, 2 bit re-reference prediction per way
+  REPLACE_BRRIP,    // bimodal RRIP, like SRRIP but most fills are predicted distant
+  REPLACE_FIFO,     // first in first out, insertion ranks per way
+  REPLACE_RANDOM    // random victim
+};
+
+// physical page replacement, the page table is fully associative so it has its own policies
+enum PageReplacementPolicy {
+  PAGE_LRU,           // true LRU over every frame
+  PAGE_CLOCK,         // CLOCK, skips (and clears) frames referenced since the hand last passed
+  PAGE_SECOND_CHANCE  // enhanced second chance, also prefers clean frames to dirty ones
+};
+
+typedef enum ReplacementPolicy ReplacementPolicy;
+typedef enum PageReplacementPolicy PageReplacementPolicy;
+typedef struct Replacer Replacer;
+
+// Replacement state for `num_sets` sets of `set_size` ways (at most 32).
+// Every policy keeps its own compact per-set metadata:
+//   LRU/FIFO  one rank byte per way
+//   PLRU      one 32 bit tree per set
+//   RRIP      one 64 bit word of 2 bit RRPVs per set
+//   RANDOM    nothing but the generator state
+struct Replacer {
+  ReplacementPolicy policy;
+  size_t num_sets;
+  size_t set_size;
+  size_t levels;        // PLRU tree depth, log2(set_size)
+
+  uint8_t* ranks;
+  uint32_t* plru;
+  uint64_t* rrpv;
+  uint32_t seed;
+};
+
+Replacer* replacer_new(const ReplacementPolicy policy, const size_t num_sets, const size_t set_size);
+void replacer_free(Replacer* replacer);
+void replacer_reset(Replacer* replacer);
+
+// writes or reads the replacement state of a snapshot (see snapshot.h), returns false on a short read or write
+bool replacer_save(const Replacer* replacer, FILE* f);
+bool replacer_load(Replacer* replacer, FILE* f);
+
+void replacer_touch(Replacer* replacer, const size_t set, const size_t way);
+void replacer_fill(Replacer* replacer, const size_t set, const size_t way);
+size_t replacer_victim(Replacer* replacer, const size_t set);
+bool replacer_find_invalid(const Replacer* replacer, const size_t set, const uint32_t valid, size_t* way);
+
+bool replacement_policy_parse(const char* name, ReplacementPolicy* policy);
+const char* replacement_policy_name(const ReplacementPolicy policy);
+
+bool page_policy_parse(const char* name, PageReplacementPolicy* policy);
+const char* page_policy_name(const PageReplacementPolicy policy);
@@ -29,3 +29,45 @@ SetNode* Set_get_mru(const Set* set);
 SetNode* Set_get_lru(const Set* set);
 void Set_set_mru(Set* set, SetNode* node);
 void Set_set_lru(Set* set, SetNode* node);
+
+// Flat recency ranks for sets stored as arrays.
+// ranks[w] is the age of way `w`: 0 is the MRU and size - 1 is the LRU.
+
+// resets the ranks so way 0 is the MRU and the last way is the LRU
+static inline void Set_ranks_init(uint8_t* ranks, const size_t size) {
+  for (size_t way = 0; way < size; way++)
+    ranks[way] = way;
+}
+
+// moves `way` to the MRU position. every way that was more recent than `way` ages by one.
+static inline void Set_ranks_set_mru(uint8_t* ranks, const size_t size, const size_t way) {
+  uint8_t rank = ranks[way];
+
+  for (size_t i = 0; i < size; i++) {
+    if (ranks[i] < rank) ranks[i] += 1;
+  }
+  ranks[way] = 0;
+}
+
+// returns the way in the LRU position
+static inline size_t Set_ranks_get_lru(const uint8_t* ranks, const size_t size) {
+  for (size_t way = 0; way < size; way++) {
+    if (ranks[way] == size - 1) return way;
+  }
+
+  return 0;
+}
+
+// returns the least recent way whose bit is clear in `mask`, or `size` if every way is set
+static inline size_t Set_ranks_get_lru_clear(const uint8_t* ranks, const size_t size, const uint32_t mask) {
+  size_t found = size;
+
+  for (size_t way = 0; way < size; way++) {
+    if (mask & (1u << way)) continue;
+    if (found != size && ranks[way] < ranks[found]) continue;
+
+    found = way;
+  }
+
+  return found;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Snapshots hold the raw state of every structure of a hierarchy in native byte order:
+//   SnapshotHeader
+//   the Config the hierarchy was built from
+//   hierarchy counters, page table, TLB, then every cache (see _hierarchy_caches for the order)
+// they only load into a fresh hierarchy built from an identical Config by the same build.
+#define SNAPSHOT_MAGIC    "MHSS"
+#define SNAPSHOT_VERSION  4u
+
+typedef struct SnapshotHeader SnapshotHeader;
+
+struct SnapshotHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t config_size;
+};
+
+static inline bool snapshot_write(FILE* f, const void* data, const size_t size) {
+  return fwrite(data, 1, size, f) == size;
+}
+
+static inline bool snapshot_read(FILE* f, void* data, const size_t size) {
+  return fread(data, 1, size, f) == size;
+}
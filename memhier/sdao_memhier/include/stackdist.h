@@ -0,0 +1,20 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct StackDist StackDist;
+
+// One-pass LRU stack distance (Mattson) analysis for a fixed line size and number of sets.
+// Every reference is treated as allocating, which is how a write-allocate LRU cache behaves
+// without an inclusive level below it. A reference hits in a `ways`-way cache with the same
+// sets and line size exactly when its stack distance is less than `ways`.
+// Each set keeps a Fenwick tree over its access times, so a reference costs O(log M)
+// where M is the number of distinct lines that map to the set.
+StackDist* stackdist_new(const size_t num_sets, const size_t line_size, const size_t max_ways);
+void stackdist_free(StackDist* sd);
+
+void stackdist_access(StackDist* sd, const uint32_t address);
+
+// prints hits, misses and hit ratio for every associativity from 1 to max_ways
+void stackdist_print(const StackDist* sd, FILE* f);
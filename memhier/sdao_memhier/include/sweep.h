@@ -0,0 +1,22 @@
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "config.h"
+#include "hierarchy.h"
+#include "trace.h"
+
+// Feeds every reference of `trace` to every hierarchy. The trace is decoded once into shared
+// chunks and `num_threads` workers each own a slice of the hierarchies.
+// returns false if the trace had a bad access type
+bool sweep_simulate(Trace* trace, Hierarchy** hierarchies, const size_t num_hierarchies, size_t num_threads);
+
+// Simulates every configuration in `config_files` over a single pass of `trace`
+// and writes one CSV record per configuration to `out`. the first `warmup` references aren't counted.
+// returns 0 on success
+int sweep_run(Trace* trace, char* const* config_files, const size_t num_configs, size_t num_threads, const size_t warmup, FILE* out);
+
+// Simulates `config` as `parts` set partitions on their own threads and merges them. Each partition only
+// gets the references of its own sets, partition 0 also gets the rejected ones.
+Hierarchy* sweep_partitioned(Trace* trace, const Config* config, const size_t parts, const size_t warmup, bool* ok);
@@ -0,0 +1,56 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "config_consts.h"
+
+// Hit masks are 32 bits wide, one bit per way
+_Static_assert(MAX_ASSOCIATIVITY <= 32, "tag_match masks only cover 32 ways");
+
+// Compares `tag` against the `n` contiguous tags of a set.
+// Returns a bitmask with bit `w` set when tags[w] == tag. Validity is up to the caller.
+// Uses 4-wide SSE2 compares when compiled in, the tail falls back to scalar.
+static inline uint32_t tag_match(const uint32_t* tags, const size_t n, const uint32_t tag) {
+  uint32_t mask = 0;
+  size_t i = 0;
+
+#ifdef __SSE2__
+  const __m128i needle4 = _mm_set1_epi32((int) tag);
+  for (; i + 4 <= n; i += 4) {
+    __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(tags + i)), needle4);
+    mask |= (uint32_t) _mm_movemask_ps(_mm_castsi128_ps(eq)) << i;
+  }
+#endif
+
+  for (; i < n; i++) {
+    mask |= (uint32_t)(tags[i] == tag) << i;
+  }
+
+  return mask;
+}
+
+// Same as tag_match for 64 bit tags, 2-wide with SSE2.
+static inline uint32_t tag_match64(const uint64_t* tags, const size_t n, const uint64_t tag) {
+  uint32_t mask = 0;
+  size_t i = 0;
+
+#ifdef __SSE2__
+  // SSE2 has no 64 bit compare, both 32 bit halves have to match
+  const __m128i needle2 = _mm_set1_epi64x((long long) tag);
+  for (; i + 2 <= n; i += 2) {
+    __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(tags + i)), needle2);
+    eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+    mask |= (uint32_t) _mm_movemask_pd(_mm_castsi128_pd(eq)) << i;
+  }
+#endif
+
+  for (; i < n; i++) {
+    mask |= (uint32_t)(tags[i] == tag) << i;
+  }
+
+  return mask;
+}
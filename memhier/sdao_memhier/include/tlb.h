@@ -2,28 +2,39 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 
 typedef struct TLBStats TLBStats;
 typedef struct TLB TLB;
 
 #include "ptable.h"
+#include "replace.h"
 
 struct TLBStats {
-  uint32_t address;
-  uint32_t tag;
+  uint64_t tag;
   uint32_t index;
   uint32_t offset;
   uint32_t ppage;
-  uint32_t vpage;
+  uint64_t vpage;
 
   bool hit;
 
   size_t hits;
   size_t total_accesses;
+  size_t shootdowns;      // entries invalidated because their physical page was evicted
 };
 
-TLB* TLB_new(PTable* ptable, const size_t num_sets, const size_t set_size, const size_t page_size);
+TLB* TLB_new(PTable* ptable, const size_t num_sets, const size_t set_size, const size_t page_size, const ReplacementPolicy replacement);
 void TLB_free(TLB* tlb);
 TLBStats* TLB_stats(const TLB* tlb);
-uint32_t TLB_virt_phys(TLB* tlb, const uint32_t v_addr, bool write);
+// zeroes the counters, the entries stay
+void TLB_reset_stats(TLB* tlb);
+uint32_t TLB_virt_phys(TLB* tlb, const uint64_t v_addr, bool write);
+
+// every lookup adds `latency` to `*cycles`
+void TLB_set_timing(TLB* tlb, uint64_t* cycles, const size_t latency);
+// snapshot state (see snapshot.h), the entries and the stats
+bool TLB_save(const TLB* tlb, FILE* f);
+bool TLB_load(TLB* tlb, FILE* f);
+
 void TLB_invalidate_ppage(TLB* tlb, const uint32_t ppage);
@@ -0,0 +1,57 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Text traces hold one "<R|W|I>:<hex address>[:<core>]" reference per line, the core defaults to 0.
+// I is an instruction fetch.
+// Binary trace layout (native byte order), addresses wider than 32 bits, fetches and other cores need a text trace:
+//   TraceHeader
+//   blocks of { uint32_t writes; uint32_t addresses[TRACE_BLOCK_SIZE]; }
+// bit `i` of `writes` is set when addresses[i] is a write.
+// the last block only holds as many addresses as are left over.
+#define TRACE_MAGIC       "MHTR"
+#define TRACE_VERSION     1u
+#define TRACE_BLOCK_SIZE  32u
+
+enum TraceStatus {
+  TRACE_OK,         // a reference was read
+  TRACE_SKIP,       // the line couldn't be parsed and was skipped
+  TRACE_BAD_TYPE,   // the access type was neither R, W nor I
+  TRACE_END         // no references left
+};
+
+enum TraceAccess {
+  TRACE_READ,
+  TRACE_WRITE,
+  TRACE_FETCH       // instruction fetch
+};
+
+typedef enum TraceStatus TraceStatus;
+typedef enum TraceAccess TraceAccess;
+typedef struct TraceHeader TraceHeader;
+typedef struct Trace Trace;
+typedef struct TraceWriter TraceWriter;
+
+struct TraceHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t count;
+};
+
+Trace* trace_open_text(FILE* f);
+Trace* trace_open_binary(const char* filename);
+void trace_close(Trace* trace);
+
+TraceStatus trace_next(Trace* trace, TraceAccess* access, uint64_t* address, uint32_t* core);
+
+// writes a binary trace, the header's count is filled in on close
+TraceWriter* trace_writer_open(const char* filename);
+void trace_writer_put(TraceWriter* writer, const bool write, const uint32_t address);
+// returns the number of references written, or -1 when the file couldn't be written
+long trace_writer_close(TraceWriter* writer);
+
+// converts a text trace from `in` into a binary trace at `filename`
+// returns the number of references written, or -1 on error
+long trace_convert(FILE* in, const char* filename);
@@ -0,0 +1,48 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "trace.h"
+
+enum TracePattern {
+  PATTERN_SEQUENTIAL,   // consecutive words, wrapping around the footprint
+  PATTERN_STRIDED,      // `stride` bytes apart, wrapping around the footprint
+  PATTERN_UNIFORM,      // uniformly random words of the footprint
+  PATTERN_ZIPF,         // zipf distributed lines, the hottest ones first from the base
+  PATTERN_CHASE         // a pointer chase through one random cycle over every line
+};
+
+typedef enum TracePattern TracePattern;
+typedef struct TraceGenSpec TraceGenSpec;
+
+// Describes a synthetic trace, parsed from "pattern[,key=value...]".
+// Numbers take a 0x prefix for hex. The same spec and seed always give the same trace.
+struct TraceGenSpec {
+  TracePattern pattern;
+  uint64_t count;       // references
+  uint64_t base;        // lowest address
+  uint64_t footprint;   // bytes covered from the base
+  uint64_t stride;      // bytes between strided references
+  uint64_t line;        // bytes per zipf item or chase node
+  double alpha;         // zipf exponent
+  double writes;        // fraction of references that are writes
+  uint64_t seed;
+};
+
+// fills `spec` from a "pattern[,key=value...]" string, printing what's wrong when it can't
+bool tracegen_parse(const char* str, TraceGenSpec* spec);
+
+// writes the trace as text to `f`, returns whether it could
+bool tracegen_text(const TraceGenSpec* spec, FILE* f);
+
+// writes the trace as a binary trace at `filename`
+// returns the number of references written, or -1 on error
+long tracegen_binary(const TraceGenSpec* spec, const char* filename);
+
+// stores the trace in memory, `addresses` and `writes` need room for spec->count references
+bool tracegen_fill(const TraceGenSpec* spec, uint64_t* addresses, bool* writes);
+
+bool trace_pattern_parse(const char* name, TracePattern* pattern);
+const char* trace_pattern_name(const TracePattern pattern);
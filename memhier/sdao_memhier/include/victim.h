@@ -0,0 +1,37 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "replace.h"
+
+#define VICTIM_MAX_ENTRIES 32u   // entries are tracked in 32 bit masks
+
+typedef struct VictimCache VictimCache;
+
+// A small fully associative LRU buffer of the lines a cache evicted, by line number (address / line_size).
+// valid and dirty have bit `i` describing entry `i`.
+struct VictimCache {
+  size_t entries;
+  uint32_t* lines;
+  uint32_t valid;
+  uint32_t dirty;
+  Replacer* replacer;
+};
+
+VictimCache* victim_new(const size_t entries);
+void victim_free(VictimCache* victim);
+void victim_reset(VictimCache* victim);
+
+// snapshot state (see snapshot.h)
+bool victim_save(const VictimCache* victim, FILE* f);
+bool victim_load(VictimCache* victim, FILE* f);
+
+// takes `line` out of the victim cache, returns whether it was there and stores whether it was dirty
+bool victim_take(VictimCache* victim, const uint32_t line, bool* dirty);
+
+bool victim_holds(const VictimCache* victim, const uint32_t line);
+
+// puts an evicted line in, returns whether that pushed out another valid line (stored in `displaced`)
+bool victim_insert(VictimCache* victim, const uint32_t line, const bool dirty, uint32_t* displaced, bool* displaced_dirty);
@@ -0,0 +1,71 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Buffered writer for the per-reference table rows.
+// Fields are formatted by hand into a large buffer that's handed to stdio in bulk,
+// which is much cheaper than a printf per row.
+
+#define WRITER_BUFFER_SIZE (1u << 16)
+
+// the widest single append (a %08x field padded to a row column) must always fit
+#define WRITER_MAX_FIELD 32u
+
+typedef struct Writer Writer;
+
+struct Writer {
+  FILE* f;
+  bool failed;    // a flush came up short
+  size_t len;
+  char buf[WRITER_BUFFER_SIZE];
+};
+
+Writer* writer_new(FILE* f);
+void writer_flush(Writer* writer);
+// flushes what's left, returns false if any flush came up short
+bool writer_free(Writer* writer);
+
+static inline void _writer_reserve(Writer* writer, const size_t n) {
+  if (writer->len + n > WRITER_BUFFER_SIZE)
+    writer_flush(writer);
+}
+
+static inline void writer_char(Writer* writer, const char c) {
+  _writer_reserve(writer, 1);
+  writer->buf[writer->len++] = c;
+}
+
+static inline void writer_spaces(Writer* writer, size_t n) {
+  while (n--) writer_char(writer, ' ');
+}
+
+// same as printf("%*x") or printf("%0*x") when `zero_pad` is set
+static inline void writer_hex(Writer* writer, uint64_t value, const size_t width, const bool zero_pad) {
+  static const char digits[] = "0123456789abcdef";
+  char tmp[16];
+  size_t n = 0;
+
+  do {
+    tmp[n++] = digits[value & 0xf];
+    value >>= 4;
+  } while (value);
+
+  _writer_reserve(writer, WRITER_MAX_FIELD);
+  for (size_t i = n; i < width; i++)
+    writer->buf[writer->len++] = zero_pad ? '0' : ' ';
+  while (n)
+    writer->buf[writer->len++] = tmp[--n];
+}
+
+// same as printf("%-*s")
+static inline void writer_str(Writer* writer, const char* s, const size_t width) {
+  size_t i = 0;
+
+  _writer_reserve(writer, WRITER_MAX_FIELD);
+  for (; s[i]; i++)
+    writer->buf[writer->len++] = s[i];
+  for (; i < width; i++)
+    writer->buf[writer->len++] = ' ';
+}
@@ -5,13 +5,19 @@
 #include <limits.h>
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 #include "config_consts.h"
 #include "util.h"
 #include "cache.h"
-#include "set.h"
+#include "mshr.h"
+#include "prefetch.h"
+#include "replace.h"
+#include "snapshot.h"
+#include "tagmatch.h"
+#include "victim.h"
 
 typedef struct DecodeConstants DecodeConstants;
-typedef struct CacheEntry CacheEntry;
+typedef struct SampleConstants SampleConstants;
 
 struct DecodeConstants {
   size_t index_pos;
@@ -22,10 +28,15 @@ struct DecodeConstants {
   uint32_t offset_mask;
 };
 
-struct CacheEntry {
-  uint32_t tag;
-  bool valid;
-  bool dirty;
+// Set sampling keeps only the sets whose index has `bits` bits starting at `pos` equal to the sampled value.
+// Only those sets are stored, packed by squeezing the sampled bits out of the index.
+struct SampleConstants {
+  size_t bits;              // log2 of the sampling ratio, 0 when every set is simulated
+  size_t pos;               // position of the sampled bits within the index
+  uint32_t low_mask;        // index bits below the sampled bits
+  uint32_t address_mask;    // address bits that select the sampled sets
+  uint32_t address_value;   // value those bits need for a reference to be simulated
+  uint32_t index_value;     // the same value as index bits
 };
 
 struct Cache {
@@ -35,19 +46,93 @@ struct Cache {
   size_t line_size;
   WritePolicy write_policy;
   WriteMissPolicy write_miss_policy;
+  ReplacementPolicy replacement;
 
   // Decoding
   DecodeConstants decode;
+  SampleConstants sample;
+  size_t stored_sets;
 
   // Table
-  Set** sets;
+  // Sets are addressed by their stored position (see _cache_set), which is the index unless sampling.
+  // Ways of a set are stored contiguously, so way `w` of set `i` lives at [i * set_size + w].
+  // valid and dirty are per-set bitmasks with bit `w` describing way `w`.
+  // replacer keeps the replacement policy's own metadata for every set.
+  uint32_t* tags;
+  Replacer* replacer;
+  uint32_t* valid;
+  uint32_t* dirty;
 
-  // multi-level cache access
+  // per set counters, used to put a confidence interval on sampled miss ratios
+  uint64_t* set_accesses;
+  uint64_t* set_misses;
+
+  // scratch space for collecting the lines of a large invalidation range, one slot per stored line
+  uint32_t* range_lines;
+
+  // demand accesses so far, the time base of prefetching and the MSHRs
+  uint64_t clock;
+
+  // prefetching, only allocated with a prefetcher.
+  // prefetched is a per-set bitmask of lines a prefetch filled that haven't been used yet,
+  // issued_at holds when each of those lines was fetched
+  // and polluters remembers, per line slot, the line (plus one) the last prefetch fill there evicted.
+  Prefetcher* prefetcher;
+  PrefetchStats* pf_stats;
+  uint32_t* prefetched;
+  uint64_t* issued_at;
+  uint32_t* polluters;
+
+  // latency model, `cycles` is the running cost of the current reference (NULL when not timed)
+  uint64_t* cycles;
+  size_t latency;
+  size_t memory_latency;
+
+  // victim cache and MSHRs, only allocated when configured
+  VictimCache* victim;
+  VictimStats* victim_stats;
+  MSHRFile* mshr;
+  MSHRStats* mshr_stats;
+
+  // coherence, only allocated for a coherent cache.
+  // shared is a per-set bitmask of lines other caches may hold too (S and O, M and E otherwise)
+  // and stolen remembers, per line slot, the line (plus one) another cache's write last invalidated there.
+  CoherenceProtocol protocol;
+  CoherenceStats* coherence_stats;
+  uint32_t* shared;
+  uint32_t* stolen;
+
+  // 3C miss classification, only allocated when asked for
+  MissClassifier* classifier;
+  MissStats* miss_stats;
+
+  // instrumentation, reuse_stats and last_use (per line slot, the reuse clock of the line's last fill or hit)
+  // are always allocated but only kept up to date while `instrumented`
+  bool instrumented;
+  uint64_t reuse_clock;
+  uint64_t* last_use;
+  ReuseStats* reuse_stats;
+
+  // multi-level cache access, several caches can share one next level
+  InclusionPolicy inclusion;
   Cache* next;
-  Cache* prev;
+  Cache** prevs;
+  size_t num_prevs;
   CacheStats* stats;
 };
 
+static const char* protocol_names[] = {
+  [COHERENCE_NONE] = "none",
+  [COHERENCE_MESI] = "mesi",
+  [COHERENCE_MOESI] = "moesi",
+};
+
+static const char* inclusion_names[] = {
+  [INCLUSION_INCLUSIVE] = "inclusive",
+  [INCLUSION_NINE] = "nine",
+  [INCLUSION_EXCLUSIVE] = "exclusive",
+};
+
 void cache_decode_debug(const Cache* cache, const char* cache_name) {
   static const char format_num[] = "\t%-20s %5lu\n";
   static const char format_str[] = "\t%-20s %10s\n";
@@ -58,6 +143,7 @@ void cache_decode_debug(const Cache* cache, const char* cache_name) {
   printf(format_num, "line_size", cache->line_size);
   printf(format_str, "write policy", cache->write_policy == WRITE_THROUGH ? "write_through" : "write_back");
   printf(format_str, "write miss policy", cache->write_miss_policy == WRALLOC ? "write allocate" : "no write allocate");
+  printf(format_str, "replacement", replacement_policy_name(cache->replacement));
   
   printf("\tindex_pos  : %lu\n", cache->decode.index_pos); 
   printf("\ttag_pos    : %lu\n", cache->decode.tag_pos);
@@ -75,7 +161,8 @@ void cache_decode_debug(const Cache* cache, const char* cache_name) {
 
 void cache_connect(Cache* prev, Cache* next) {
   prev->next = next;
-  next->prev = prev;
+  next->prevs = realloc(next->prevs, sizeof(Cache*) * (next->num_prevs + 1));
+  next->prevs[next->num_prevs++] = prev;
 }
 
 void _cache_decode(const Cache* cache, const uint32_t address, uint32_t* tag, uint32_t* index) {
@@ -83,44 +170,130 @@ void _cache_decode(const Cache* cache, const uint32_t address, uint32_t* tag, ui
   *index = (address >> cache->decode.index_pos) & cache->decode.index_mask;
 }
 
+// maps a set index to the position the set is stored at
+static inline uint32_t _cache_set(const Cache* cache, const uint32_t index) {
+  return ((index >> (cache->sample.pos + cache->sample.bits)) << cache->sample.pos) | (index & cache->sample.low_mask);
+}
+
+// maps a stored set position back to its set index
+static inline uint32_t _cache_index(const Cache* cache, const uint32_t set) {
+  return ((set >> cache->sample.pos) << (cache->sample.pos + cache->sample.bits)) | cache->sample.index_value | (set & cache->sample.low_mask);
+}
+
+static inline bool _cache_sampled(const Cache* cache, const uint32_t address) {
+  return (address & cache->sample.address_mask) == cache->sample.address_value;
+}
+
 // invalidates the entire cache. this isn't concerned with writing back dirty lines.
+// also resets the replacement state (for LRU way 0 is the MRU and the last way is the LRU).
 void cache_invalidate_all(Cache* cache) {
-  for (size_t i = 0; i < cache->num_sets; i++) {
-    Set* set = cache->sets[i];
-    CacheEntry* entries = set->node_list->data;
-    memset(entries + 1, 0, sizeof(CacheEntry) * cache->set_size); 
+  memset(cache->valid, 0, sizeof(uint32_t) * cache->stored_sets);
+  memset(cache->dirty, 0, sizeof(uint32_t) * cache->stored_sets);
+
+  replacer_reset(cache->replacer);
+
+  if (cache->prefetcher) {
+    memset(cache->prefetched, 0, sizeof(uint32_t) * cache->stored_sets);
+    memset(cache->polluters, 0, sizeof(uint32_t) * cache->stored_sets * cache->set_size);
+    prefetcher_reset(cache->prefetcher);
   }
+  if (cache->victim) victim_reset(cache->victim);
+  if (cache->mshr) mshr_reset(cache->mshr);
+  if (cache->protocol != COHERENCE_NONE)
+    memset(cache->stolen, 0, sizeof(uint32_t) * cache->stored_sets * cache->set_size);
+}
+
+void cache_reset_stats(Cache* cache) {
+  CacheStats* stats = cache->stats;
+
+  stats->hits = 0;
+  stats->reads = 0;
+  stats->mem_accesses = 0;
+  stats->total_accesses = 0;
+  stats->back_invalidations = 0;
+  stats->victim_fills = 0;
+
+  memset(cache->set_accesses, 0, sizeof(uint64_t) * cache->stored_sets);
+  memset(cache->set_misses, 0, sizeof(uint64_t) * cache->stored_sets);
+  if (cache->pf_stats) memset(cache->pf_stats, 0, sizeof(PrefetchStats));
+  if (cache->victim_stats) memset(cache->victim_stats, 0, sizeof(VictimStats));
+  if (cache->mshr_stats) memset(cache->mshr_stats, 0, sizeof(MSHRStats));
+  if (cache->coherence_stats) memset(cache->coherence_stats, 0, sizeof(CoherenceStats));
+  if (cache->miss_stats) memset(cache->miss_stats, 0, sizeof(MissStats));
+  memset(cache->reuse_stats, 0, sizeof(ReuseStats));
 }
 
 void cache_free(Cache* cache) {
-  for (size_t i = 0; i < cache->num_sets; i++) {
-    Set* set = cache->sets[i];
-    free(set->node_list->data);
-    Set_free(set);
+  free(cache->tags);
+  replacer_free(cache->replacer);
+  free(cache->valid);
+  free(cache->dirty);
+  free(cache->set_accesses);
+  free(cache->set_misses);
+  free(cache->range_lines);
+  if (cache->prefetcher) prefetcher_free(cache->prefetcher);
+  free(cache->pf_stats);
+  free(cache->prefetched);
+  free(cache->issued_at);
+  free(cache->polluters);
+  if (cache->victim) victim_free(cache->victim);
+  free(cache->victim_stats);
+  if (cache->mshr) mshr_free(cache->mshr);
+  free(cache->mshr_stats);
+  free(cache->coherence_stats);
+  free(cache->shared);
+  free(cache->stolen);
+  if (cache->classifier) classifier_free(cache->classifier);
+  free(cache->miss_stats);
+  free(cache->last_use);
+  free(cache->reuse_stats);
+  free(cache->prevs);
+  free(cache->stats);
+  free(cache);
+}
+
+// (re)allocates storage for `stored_sets` sets and invalidates everything
+static void _cache_alloc_sets(Cache* cache) {
+  size_t lines = cache->stored_sets * cache->set_size;
+
+  // one allocation per field for the whole cache rather than one per set
+  cache->tags = realloc(cache->tags, sizeof(uint32_t) * lines);
+  if (cache->replacer) replacer_free(cache->replacer);
+  cache->replacer = replacer_new(cache->replacement, cache->stored_sets, cache->set_size);
+  cache->valid = realloc(cache->valid, sizeof(uint32_t) * cache->stored_sets);
+  cache->dirty = realloc(cache->dirty, sizeof(uint32_t) * cache->stored_sets);
+  cache->range_lines = realloc(cache->range_lines, sizeof(uint32_t) * lines);
+  free(cache->last_use);
+  cache->last_use = calloc(lines, sizeof(uint64_t));
+  if (cache->prefetcher) {
+    cache->prefetched = realloc(cache->prefetched, sizeof(uint32_t) * cache->stored_sets);
+    cache->issued_at = realloc(cache->issued_at, sizeof(uint64_t) * lines);
+    cache->polluters = realloc(cache->polluters, sizeof(uint32_t) * lines);
+  }
+  if (cache->protocol != COHERENCE_NONE) {
+    cache->shared = realloc(cache->shared, sizeof(uint32_t) * cache->stored_sets);
+    cache->stolen = realloc(cache->stolen, sizeof(uint32_t) * lines);
+  }
+  // the shadow cache holds as many lines as the stored sets
+  if (cache->classifier) {
+    classifier_free(cache->classifier);
+    cache->classifier = classifier_new(lines, 32 - cache->decode.index_pos);
   }
+
+  free(cache->set_accesses);
+  free(cache->set_misses);
+  cache->set_accesses = calloc(cache->stored_sets, sizeof(uint64_t));
+  cache->set_misses = calloc(cache->stored_sets, sizeof(uint64_t));
+
+  memset(cache->tags, 0, sizeof(uint32_t) * lines);
+  cache_invalidate_all(cache);
 }
 
 // Assumes proper inputs
-Cache* cache_new(const size_t num_sets, const size_t set_size, const size_t line_size, const WritePolicy write_policy, const WriteMissPolicy write_miss_policy) {
-  Cache* cache = malloc(sizeof(Cache));
+Cache* cache_new(const size_t num_sets, const size_t set_size, const size_t line_size, const WritePolicy write_policy, const WriteMissPolicy write_miss_policy, const ReplacementPolicy replacement) {
+  Cache* cache = calloc(1, sizeof(Cache));
   cache->stats = calloc(1, sizeof(CacheStats));
-  cache->sets = malloc(sizeof(Set*) * num_sets);
-  
-  // configure sets and cache entries 
-  for (size_t i = 0; i < num_sets; i++) {
-    Set* set = cache->sets[i] = Set_new(set_size);
-    
-    // sentinel will also be assigned a CacheEntry (though itll never be used)
-    // This makes it easier to handle a continous CacheEntry array
-    CacheEntry* entries = calloc(set_size + 1, sizeof(CacheEntry));
-    SetNode* node_list = set->node_list;
-    
-    // connect set data to cache entries
-    for (size_t j = 0; j < set_size + 1; j++) {
-      node_list[j].data = (void*)(entries + j);
-    }
-
-  }
+  cache->reuse_stats = calloc(1, sizeof(ReuseStats));
 
   // fill in decode data
   cache->decode.index_pos = log_2(line_size);
@@ -128,52 +301,234 @@ Cache* cache_new(const size_t num_sets, const size_t set_size, const size_t line
   cache->decode.offset_mask = ~(~(0u) << cache->decode.index_pos);
   cache->decode.index_mask = ~(~(0u) << (cache->decode.tag_pos - cache->decode.index_pos));
   cache->decode.tag_mask = ~(~(0u) << (32 - cache->decode.tag_pos));
+
+  // no sampling, every set is stored at its own index
+  cache->sample.pos = log_2(num_sets);
+  cache->sample.low_mask = cache->decode.index_mask;
   
   // configuration information
   cache->num_sets = num_sets;
+  cache->stored_sets = num_sets;
   cache->set_size = set_size;
   cache->line_size = line_size;
   cache->write_policy = write_policy;
   cache->write_miss_policy = write_miss_policy;
-  cache->next = cache->prev = NULL;
+  cache->replacement = replacement;
+  cache->next = NULL;
 
-  cache_invalidate_all(cache);
+  _cache_alloc_sets(cache);
 
   return cache;
 }
 
-CacheStats* cache_stats(const Cache* cache) {
-  return cache->stats;
+void cache_set_timing(Cache* cache, uint64_t* cycles, const size_t latency, const size_t memory_latency) {
+  cache->cycles = cycles;
+  cache->latency = latency;
+  cache->memory_latency = memory_latency;
+}
+
+void cache_set_prefetcher(Cache* cache, const PrefetchPolicy policy, const size_t degree) {
+  if (policy == PREFETCH_NONE) return;
+
+  cache->prefetcher = prefetcher_new(policy, degree, cache->line_size);
+  cache->pf_stats = calloc(1, sizeof(PrefetchStats));
+  _cache_alloc_sets(cache);
+}
+
+PrefetchStats* cache_prefetch_stats(const Cache* cache) {
+  return cache->pf_stats;
+}
+
+void cache_set_victim(Cache* cache, const size_t entries) {
+  if (!entries) return;
+
+  cache->victim = victim_new(entries);
+  cache->victim_stats = calloc(1, sizeof(VictimStats));
+}
+
+VictimStats* cache_victim_stats(const Cache* cache) {
+  return cache->victim_stats;
+}
+
+void cache_set_mshrs(Cache* cache, const size_t entries, const uint64_t miss_time) {
+  if (!entries) return;
+
+  cache->mshr = mshr_new(entries, miss_time);
+  cache->mshr_stats = calloc(1, sizeof(MSHRStats));
+}
+
+MSHRStats* cache_mshr_stats(const Cache* cache) {
+  return cache->mshr_stats;
+}
+
+void cache_set_classify(Cache* cache, const bool classify) {
+  if (!classify) return;
+
+  cache->classifier = classifier_new(cache->stored_sets * cache->set_size, 32 - cache->decode.index_pos);
+  cache->miss_stats = calloc(1, sizeof(MissStats));
+}
+
+MissStats* cache_miss_stats(const Cache* cache) {
+  return cache->miss_stats;
+}
+
+void cache_set_instrument(Cache* cache, const bool instrument) {
+  cache->instrumented = instrument;
+}
+
+ReuseStats* cache_reuse_stats(const Cache* cache) {
+  return cache->reuse_stats;
+}
+
+size_t cache_num_sets(const Cache* cache) {
+  return cache->num_sets;
+}
+
+bool cache_set_counts(const Cache* cache, const uint32_t index, uint64_t* accesses, uint64_t* misses) {
+  if (index >= cache->num_sets || !_cache_sampled(cache, index << cache->decode.index_pos)) return false;
+
+  uint32_t set = _cache_set(cache, index);
+  *accesses = cache->set_accesses[set];
+  *misses = cache->set_misses[set];
+  return true;
+}
+
+void cache_set_coherence(Cache* cache, const CoherenceProtocol protocol) {
+  if (protocol == COHERENCE_NONE) return;
+
+  cache->protocol = protocol;
+  cache->coherence_stats = calloc(1, sizeof(CoherenceStats));
+  _cache_alloc_sets(cache);
+}
+
+CoherenceStats* cache_coherence_stats(const Cache* cache) {
+  return cache->coherence_stats;
+}
+
+bool coherence_protocol_parse(const char* name, CoherenceProtocol* protocol) {
+  for (size_t i = 0; i < sizeof(protocol_names) / sizeof(protocol_names[0]); i++) {
+    if (strcmp(name, protocol_names[i])) continue;
+
+    *protocol = (CoherenceProtocol) i;
+    return true;
+  }
+
+  return false;
+}
+
+const char* coherence_protocol_name(const CoherenceProtocol protocol) {
+  return protocol_names[protocol];
 }
 
-bool _cache_find(const Cache* cache, const uint32_t tag, const uint32_t index, SetNode** node) {
-  Set* set = cache->sets[index];
+void cache_set_inclusion(Cache* cache, const InclusionPolicy inclusion) {
+  cache->inclusion = inclusion;
+}
 
-  SetNode* cur;
-  SET_TRAVERSE_RIGHT(cur, set->node_list) {
-    CacheEntry* entry = (CacheEntry*) cur->data;
-    if (entry->tag != tag || !entry->valid) continue;
+bool inclusion_policy_parse(const char* name, InclusionPolicy* inclusion) {
+  for (size_t i = 0; i < sizeof(inclusion_names) / sizeof(inclusion_names[0]); i++) {
+    if (strcmp(name, inclusion_names[i])) continue;
 
-    *node = cur;
+    *inclusion = (InclusionPolicy) i;
     return true;
   }
 
   return false;
 }
 
+const char* inclusion_policy_name(const InclusionPolicy inclusion) {
+  return inclusion_names[inclusion];
+}
+
+// Only simulates the sets whose index bits under `address_mask` equal `address_value`.
+// `address_mask` has to be a contiguous run of bits inside the index field.
+// References outside the sample must not be passed to cache_read or cache_write.
+// Resets the contents of the cache. returns false if the mask doesn't fit the index.
+bool cache_sample(Cache* cache, const uint32_t address_mask, const uint32_t address_value) {
+  uint32_t index_mask = cache->decode.index_mask << cache->decode.index_pos;
+  if ((address_mask & index_mask) != address_mask || (address_value & ~address_mask)) return false;
+
+  size_t pos = address_mask ? __builtin_ctz(address_mask) : 0;
+  size_t bits = __builtin_popcount(address_mask);
+  if (address_mask && (address_mask >> pos) != ~(~0u << bits)) return false;
+
+  if (address_mask) {
+    cache->sample.bits = bits;
+    cache->sample.pos = pos - cache->decode.index_pos;
+    cache->sample.low_mask = ~(~0u << cache->sample.pos);
+  } else {
+    cache->sample.bits = 0;
+    cache->sample.pos = log_2(cache->num_sets);
+    cache->sample.low_mask = cache->decode.index_mask;
+  }
+  cache->sample.address_mask = address_mask;
+  cache->sample.address_value = address_value;
+  cache->sample.index_value = address_value >> cache->decode.index_pos;
+  cache->stored_sets = cache->num_sets >> bits;
+
+  _cache_alloc_sets(cache);
+  return true;
+}
+
+// Estimates the miss ratio of the whole cache from the simulated sets, treating each set as a
+// cluster of accesses (ratio estimator). Stores the half width of a 95% confidence interval in
+// `half_width`, which is NAN when there aren't enough sets with accesses to estimate it.
+double cache_sample_miss_ratio(const Cache* cache, double* half_width) {
+  uint64_t accesses = 0, misses = 0;
+  for (size_t i = 0; i < cache->stored_sets; i++) {
+    accesses += cache->set_accesses[i];
+    misses += cache->set_misses[i];
+  }
+
+  *half_width = NAN;
+  if (!accesses) return NAN;
+
+  double ratio = (double) misses / (double) accesses;
+  size_t n = cache->stored_sets;
+  if (n < 2) return ratio;
+
+  double sum_sq = 0;
+  for (size_t i = 0; i < n; i++) {
+    double residual = (double) cache->set_misses[i] - ratio * (double) cache->set_accesses[i];
+    sum_sq += residual * residual;
+  }
+
+  double mean_accesses = (double) accesses / (double) n;
+  double fpc = 1.0 - (double) n / (double) cache->num_sets;
+  double variance = fpc * sum_sq / ((double)(n - 1) * (double) n * mean_accesses * mean_accesses);
+  *half_width = 1.96 * sqrt(variance);
+
+  return ratio;
+}
+
+CacheStats* cache_stats(const Cache* cache) {
+  return cache->stats;
+}
+
+bool _cache_find(const Cache* cache, const uint32_t tag, const uint32_t set, size_t* way) {
+  uint32_t hits = tag_match(cache->tags + set * cache->set_size, cache->set_size, tag) & cache->valid[set];
+  if (!hits) return false;
+
+  // tags are unique among the valid ways of a set
+  *way = __builtin_ctz(hits);
+  return true;
+}
 void _cache_writeback(Cache* cache, const uint32_t address, bool update_lru) {
   if (cache->next) {
     cache_write(cache->next, address, update_lru);
   } else {
     cache->stats->mem_accesses += 1;
+    if (cache->cycles) *cache->cycles += cache->memory_latency;
   }
 }
 
-void _cache_readback(Cache* cache, const uint32_t address) {
+// returns whether the line came back dirty, which only an exclusive next level does
+bool _cache_readback(Cache* cache, const uint32_t address) {
   if (cache->next)
-    cache_read(cache->next, address);
-  else
-    cache->stats->mem_accesses += 1;
+    return cache_read(cache->next, address);
+
+  cache->stats->mem_accesses += 1;
+  if (cache->cycles) *cache->cycles += cache->memory_latency;
+  return false;
 }
 
 static inline uint32_t _cache_address_from_tag_index(const Cache* cache, uint32_t tag, uint32_t index) {
@@ -182,134 +537,657 @@ static inline uint32_t _cache_address_from_tag_index(const Cache* cache, uint32_
   return tag | index; 
 }
 
-// address low and address high will have their index bits ignored
+// COHERENCE
+
+// Snoops the other coherent caches sharing the next level for a miss (or upgrade) to `address`.
+// a write invalidates their copies, a read leaves them shared, writing back a dirty MESI line.
+// returns whether another cache held the line, `supplied` is set when one of them had it dirty.
+static bool _cache_snoop(Cache* cache, const uint32_t address, const bool write, bool* supplied) {
+  bool held = false;
+
+  if (!cache->next) return false;
+
+  for (size_t i = 0; i < cache->next->num_prevs; i++) {
+    Cache* peer = cache->next->prevs[i];
+    uint32_t tag, index, set;
+    size_t way;
+
+    if (peer == cache || peer->protocol == COHERENCE_NONE) continue;
+
+    _cache_decode(peer, address, &tag, &index);
+    set = _cache_set(peer, index);
+    if (!_cache_find(peer, tag, set, &way)) continue;
+
+    uint32_t bit = 1u << way;
+    uint32_t line_address = address & ~peer->decode.offset_mask;
+    held = true;
+    if (peer->dirty[set] & bit)
+      *supplied = true;
+
+    if (write) {
+      // the writer takes the dirty line over, only a cache that doesn't allocate on writes needs it written back
+      if (cache->write_miss_policy == WRALLOC)
+        peer->dirty[set] &= ~bit;
+      peer->stolen[set * peer->set_size + way] = (address >> peer->decode.index_pos) + 1;
+      peer->coherence_stats->invalidations += 1;
+      cache_invalidate_range(peer, line_address, line_address + peer->line_size - 1);
+      continue;
+    }
+
+    // M goes to S by writing back under MESI and to O under MOESI, E goes to S
+    if ((peer->dirty[set] & bit) && peer->protocol == COHERENCE_MESI) {
+      peer->dirty[set] &= ~bit;
+      _cache_writeback(peer, line_address, false);
+    }
+    peer->shared[set] |= bit;
+  }
+
+  return held;
+}
+
+// sets the sharing state of a line just filled, counting misses on lines another cache took away
+static void _cache_coherent_fill(Cache* cache, const uint32_t address, const uint32_t set, const size_t way, const bool shared) {
+  const uint32_t line = (address >> cache->decode.index_pos) + 1;
+  const size_t base = set * cache->set_size;
+
+  if (shared)
+    cache->shared[set] |= 1u << way;
+  else
+    cache->shared[set] &= ~(1u << way);
+
+  for (size_t i = 0; i < cache->set_size; i++) {
+    if (cache->stolen[base + i] != line) continue;
+
+    cache->stolen[base + i] = 0;
+    cache->coherence_stats->coherence_misses += 1;
+    break;
+  }
+}
+
+// a write to a line other caches may hold invalidates their copies (a write to an E or M line needs nothing)
+static void _cache_upgrade(Cache* cache, const uint32_t address, const uint32_t set, const size_t way) {
+  bool supplied = false;
+
+  _cache_snoop(cache, address, true, &supplied);
+  cache->shared[set] &= ~(1u << way);
+  cache->coherence_stats->upgrades += 1;
+}
+
+// INCLUSION
+
+size_t _cache_evict(Cache* cache, const uint32_t set);
+static bool _cache_fetch(Cache* cache, const uint32_t address, const bool demand);
+
+// INSTRUMENTATION
+
+// a line was just filled into `way`, its reuse distances count from here
+static inline void _cache_stamp(Cache* cache, const uint32_t set, const size_t way) {
+  if (cache->instrumented) cache->last_use[set * cache->set_size + way] = cache->reuse_clock;
+}
+
+// counts the reuse distance of an access before the cache acts on it
+static void _cache_reuse(Cache* cache, const uint32_t tag, const uint32_t set) {
+  size_t way;
+  uint64_t now = ++cache->reuse_clock;
+
+  if (!_cache_find(cache, tag, set, &way)) {
+    cache->reuse_stats->misses += 1;
+    return;
+  }
+
+  uint64_t* last = cache->last_use + set * cache->set_size + way;
+  uint64_t distance = now - *last - 1;
+  cache->reuse_stats->histogram[distance ? 64 - __builtin_clzll(distance) : 0] += 1;
+  *last = now;
+}
+
+// an exclusive cache takes the lines the levels above evict, clean or dirty. these aren't demand accesses.
+static void _cache_victim_fill(Cache* cache, const uint32_t address, const bool dirty) {
+  uint32_t tag, index, set;
+  size_t way;
+
+  _cache_decode(cache, address, &tag, &index);
+  set = _cache_set(cache, index);
+  if (cache->cycles) *cache->cycles += cache->latency;
+  cache->stats->victim_fills += 1;
+
+  if (_cache_find(cache, tag, set, &way)) {
+    replacer_touch(cache->replacer, set, way);
+  } else {
+    if (!replacer_find_invalid(cache->replacer, set, cache->valid[set], &way))
+      way = _cache_evict(cache, set);
+
+    cache->tags[set * cache->set_size + way] = tag;
+    cache->valid[set] |= 1u << way;
+    cache->dirty[set] &= ~(1u << way);
+    replacer_fill(cache->replacer, set, way);
+    _cache_stamp(cache, set, way);
+  }
+  // the shadow cache takes the line too, without counting an access
+  if (cache->classifier)
+    classifier_access(cache->classifier, address >> cache->decode.index_pos);
+
+  if (!dirty) return;
+
+  // a write through cache passes the data on instead of holding it dirty
+  if (cache->write_policy == WRITE_THROUGH)
+    _cache_writeback(cache, address, false);
+  else
+    cache->dirty[set] |= 1u << way;
+}
+
+// a line leaving the cache for good goes down: an exclusive next level takes it either way,
+// otherwise only a dirty line is written back
+static void _cache_spill(Cache* cache, const uint32_t address, const bool dirty) {
+  if (cache->next && cache->next->inclusion == INCLUSION_EXCLUSIVE)
+    _cache_victim_fill(cache->next, address, dirty);
+  else if (dirty)
+    _cache_writeback(cache, address, false);
+}
+
+// a line an exclusive next level handed up dirty stays dirty here
+static void _cache_mark_dirty(Cache* cache, const uint32_t tag, const uint32_t set) {
+  size_t way;
+
+  if (_cache_find(cache, tag, set, &way))
+    cache->dirty[set] |= 1u << way;
+}
+
+// VICTIM CACHE
+
+// moves an evicted line into the victim cache, the line it pushes out leaves for the next level
+static void _cache_victim_insert(Cache* cache, const uint32_t address, const bool dirty) {
+  uint32_t displaced;
+  bool displaced_dirty;
+
+  cache->victim_stats->inserts += 1;
+  if (!victim_insert(cache->victim, address >> cache->decode.index_pos, dirty, &displaced, &displaced_dirty))
+    return;
+
+  if (displaced_dirty)
+    cache->victim_stats->writebacks += 1;
+  _cache_spill(cache, displaced << cache->decode.index_pos, displaced_dirty);
+}
+
+// invalidates the victim cache lines among the `count` lines starting at `address`, writing back dirty ones.
+// returns how many lines were invalidated
+static size_t _cache_victim_invalidate(Cache* cache, const uint32_t address, const uint64_t count) {
+  uint32_t first = address >> cache->decode.index_pos;
+  size_t invalidated = 0;
+
+  for (uint32_t valid = cache->victim->valid; valid; valid &= valid - 1) {
+    uint32_t line = cache->victim->lines[__builtin_ctz(valid)];
+    bool dirty;
+
+    if (line - first >= count || !victim_take(cache->victim, line, &dirty)) continue;
+    invalidated += 1;
+    if (dirty)
+      _cache_writeback(cache, address + (line - first) * cache->line_size, false);
+  }
+
+  return invalidated;
+}
+
+// counts a prefetched line leaving the cache before it was ever used
+static inline void _cache_drop_prefetch(Cache* cache, const uint32_t set, const size_t way) {
+  if (!cache->prefetcher || !(cache->prefetched[set] & (1u << way))) return;
+
+  cache->prefetched[set] &= ~(1u << way);
+  cache->pf_stats->unused += 1;
+}
+
+// invalidates the line holding `address` if it's cached, writing it back when dirty.
+// returns whether it was cached
+static bool _cache_invalidate_line(Cache* cache, const uint32_t address) {
+  uint32_t tag, index, set;
+  size_t way;
+
+  _cache_decode(cache, address, &tag, &index);
+  set = _cache_set(cache, index);
+
+  // invalidate the entry if found in the set
+  if (!_cache_find(cache, tag, set, &way)) return false;
+
+  // invalidate current entry
+  cache->valid[set] &= ~(1u << way);
+  _cache_drop_prefetch(cache, set, way);
+
+  // We shouldn't need to check here if it's write through
+  // dirty bits should never be set in write through anyway
+  if (!(cache->dirty[set] & (1u << way)))
+    return true;
+
+  // write_back to the previous
+  _cache_writeback(cache, address, false);
+  return true;
+}
+
+static int _cache_compare_lines(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+  return (x > y) - (x < y);
+}
+
+// address low and address high will have their offset bits ignored
 // address_high is INclusive to avoid unsigned overflow
-void cache_invalidate_range(Cache* cache, uint32_t address_low, uint32_t address_high) {
-  address_low &= ~cache->decode.index_mask;
-  address_high &= ~cache->decode.index_mask;
+size_t cache_invalidate_range(Cache* cache, uint32_t address_low, uint32_t address_high) {
+  size_t invalidated = 0;
+
+  address_low &= ~cache->decode.offset_mask;
+  address_high &= ~cache->decode.offset_mask;
 
   // propagate the invalidate message up
-  if (cache->prev)
-    cache_invalidate_range(cache->prev, address_low, address_high);
-  
-  // handle invalidation in the current cache
-  for (uint32_t addr = address_low; addr <= address_high; addr += cache->line_size) {
-    uint32_t tag, index;
-    SetNode* cur;
+  for (size_t i = 0; i < cache->num_prevs; i++)
+    invalidated += cache_invalidate_range(cache->prevs[i], address_low, address_high);
 
-    _cache_decode(cache, addr, &tag, &index);
-    
-    // invalidate the entry if found in the set
-    Set* set = cache->sets[index];
-    SET_TRAVERSE_RIGHT(cur, set->node_list) {
-      CacheEntry* entry = (CacheEntry*) cur->data;
-      if (!entry->valid || entry->tag != tag) continue;
-      
-      // invalidate current entry
-      entry->valid = false;
-      
-      // We shouldn't need to check here if it's write through
-      // dirty bits should never be set in write through anyway
-      if (!entry->dirty)
-        continue;
-
-      // write_back to the previous
-      _cache_writeback(cache, addr, false);
+  // the range covers `count` consecutive lines starting with the one holding address_low
+  uint64_t count = ((uint64_t) address_high - address_low) / cache->line_size + 1;
+
+  if (cache->victim)
+    invalidated += _cache_victim_invalidate(cache, address_low, count);
+
+  // a range no wider than the index visits each of its sets once
+  if (count <= cache->num_sets) {
+    for (uint64_t i = 0; i < count; i++) {
+      uint32_t addr = address_low + i * cache->line_size;
+
+      // lines of unsampled sets are never cached
+      if (_cache_sampled(cache, addr))
+        invalidated += _cache_invalidate_line(cache, addr);
+    }
+    return invalidated;
+  }
+
+  // a wider range (a page of many lines) maps onto every set, so walk each stored set once and
+  // collect its lines inside the range rather than looking up every line of the range
+  uint32_t first = address_low >> cache->decode.index_pos;
+  size_t found = 0;
+
+  for (uint32_t set = 0; set < cache->stored_sets; set++) {
+    uint32_t index = _cache_index(cache, set);
+
+    for (uint32_t valid = cache->valid[set]; valid; valid &= valid - 1) {
+      uint32_t tag = cache->tags[set * cache->set_size + __builtin_ctz(valid)];
+      uint32_t line = _cache_address_from_tag_index(cache, tag, index) >> cache->decode.index_pos;
+
+      // same address the line-by-line walk would use, address_low need not be line aligned
+      if (line - first < count)
+        cache->range_lines[found++] = address_low + (line - first) * cache->line_size;
     }
   }
+
+  // invalidate in address order, as writebacks to the next level update its replacement state.
+  // a writeback can back-invalidate lines collected here, so each one is looked up again.
+  qsort(cache->range_lines, found, sizeof(uint32_t), _cache_compare_lines);
+  for (size_t i = 0; i < found; i++)
+    invalidated += _cache_invalidate_line(cache, cache->range_lines[i]);
+
+  return invalidated;
 }
 
-// invalidates and evicts (if necessary) the LRU
+// invalidates and evicts (if necessary) the replacement policy's victim
 // handles writebacks from evictions and upward invalidate propagations
-// returns a node that have its cache entry replaced(BUT IS STILL IN THE LRU POSITION)
-SetNode* _cache_evict(Cache* cache, const uint32_t index) {
-  Set* set = cache->sets[index];
-  SetNode* node = Set_get_lru(set);
-  CacheEntry* entry = (CacheEntry*) node->data;
+// returns the way that had its cache entry replaced
+size_t _cache_evict(Cache* cache, const uint32_t set) {
+  size_t way = replacer_victim(cache->replacer, set);
+  uint32_t bit = 1u << way;
 
   // don't need to invalidate and write back if non-valid
-  if (!entry->valid) return node;
+  if (!(cache->valid[set] & bit)) return way;
   
   // invalidate current entry
-  entry->valid = false;
+  cache->valid[set] &= ~bit;
+  _cache_drop_prefetch(cache, set, way);
   
   // address range for upper invalidations 
-  uint32_t v_addr_low = (entry->tag & cache->decode.tag_mask) << cache->decode.tag_pos;
-  v_addr_low |= (index & cache->decode.index_mask) << cache->decode.index_pos;
+  uint32_t v_addr_low = _cache_address_from_tag_index(cache, cache->tags[set * cache->set_size + way], _cache_index(cache, set));
   uint32_t v_addr_high = v_addr_low + cache->line_size - 1;
   
   // start with the current cache (does a bit of repeatitive search)
-  if (cache->prev)
-    cache_invalidate_range(cache->prev, v_addr_low, v_addr_high);
+  // only an inclusive cache has to take the line out of the levels above
+  if (cache->inclusion == INCLUSION_INCLUSIVE) {
+    for (size_t i = 0; i < cache->num_prevs; i++)
+      cache->stats->back_invalidations += cache_invalidate_range(cache->prevs[i], v_addr_low, v_addr_high);
+  }
 
-  // flush from current cache if dirty
-  if (entry->dirty)
-    _cache_writeback(cache, v_addr_low, false);
+  // the victim cache takes the line, dirty or not. otherwise it leaves for the next level
+  if (cache->victim)
+    _cache_victim_insert(cache, v_addr_low, cache->dirty[set] & bit);
+  else
+    _cache_spill(cache, v_addr_low, cache->dirty[set] & bit);
 
    
-  return node;
+  return way;
 }
 
-static bool _cache_find_invalid(Cache* cache, const size_t index, SetNode** node) {
-  SetNode* cur;
-  SET_TRAVERSE_LEFT(cur, cache->sets[index]->node_list) {
-    CacheEntry* entry = (CacheEntry*) cur->data;
-    if (entry->valid) continue;
-    
-    *node = cur;
+// inserts a cache entry into the cache
+// handles evictions if necessary
+// returns whether it was a hit. `supplied` is set when a miss got the line from the victim cache
+// or another cache rather than the next level. `dirty` entries are writes as far as coherence goes.
+// `fetched` is set when the line was already read from an exclusive next level, `demand` as in _cache_fetch
+static bool _cache_insert(Cache* cache, const uint32_t tag, const uint32_t set, const bool dirty, const bool update_lru,
+                          const bool demand, bool* supplied, bool* fetched) {
+  size_t way;
+  bool fill_dirty = dirty;
+  bool shared = false;
+
+  *supplied = false;
+  *fetched = false;
+
+  // if hit return true
+  if (_cache_find(cache, tag, set, &way)) {
+    if (update_lru)
+      replacer_touch(cache->replacer, set, way);
     return true;
   }
 
+  uint32_t address = _cache_address_from_tag_index(cache, tag, _cache_index(cache, set));
+
+  // the line swaps places with the one evicted for it, so take it out of the victim cache first
+  if (cache->victim) {
+    bool victim_dirty;
+
+    cache->victim_stats->probes += 1;
+    if ((*supplied = victim_take(cache->victim, address >> cache->decode.index_pos, &victim_dirty))) {
+      cache->victim_stats->hits += 1;
+      fill_dirty |= victim_dirty;
+    }
+  }
+
+  // other caches give the line up for a write and share it for a read
+  if (cache->protocol != COHERENCE_NONE) {
+    bool transferred = false;
+    shared = _cache_snoop(cache, address, dirty, &transferred) && !dirty;
+    if (transferred)
+      cache->coherence_stats->transfers += 1;
+    *supplied |= transferred;
+  }
+
+  // an exclusive next level hands the line up before it takes the victim, spilling first could push out the
+  // very line being read. the two swap places instead
+  if (!*supplied && cache->next && cache->next->inclusion == INCLUSION_EXCLUSIVE) {
+    *fetched = true;
+    fill_dirty |= _cache_fetch(cache, address, demand);
+  }
+  
+  // find an invalid block to replace, otherwise evict the victim
+  if (!replacer_find_invalid(cache->replacer, set, cache->valid[set], &way))
+    way = _cache_evict(cache, set);
+
+  cache->tags[set * cache->set_size + way] = tag;
+  cache->valid[set] |= 1u << way;
+  if (fill_dirty)
+    cache->dirty[set] |= 1u << way;
+  else
+    cache->dirty[set] &= ~(1u << way);
+  if (cache->protocol != COHERENCE_NONE)
+    _cache_coherent_fill(cache, address, set, way, shared);
+
+  replacer_fill(cache->replacer, set, way);
+  _cache_stamp(cache, set, way);
   return false;
 }
 
-// inserts cache entry data into the cache
-// handles evictions if necessary
-// returns whether it was a hit
-static bool _cache_insert(Cache* cache, const size_t tag, const size_t index, const CacheEntry* new_entry, const bool update_lru) {
-  bool hit = false;
-  SetNode* node;
+// PREFETCHING
 
-  // if hit return true
-  if (_cache_find(cache, tag, index, &node)) {
-    hit = true;
-    goto L_update_lru;
+// puts back the fields describing the last reference
+static void _cache_restore_reference(CacheStats* stats, const CacheStats* saved) {
+  stats->address = saved->address;
+  stats->tag = saved->tag;
+  stats->index = saved->index;
+  stats->hit = saved->hit;
+  stats->show = saved->show;
+  stats->buffered = saved->buffered;
+  stats->type = saved->type;
+}
+
+// counts the first demand use of a prefetched line
+static void _cache_prefetch_used(Cache* cache, const uint64_t issued_at) {
+  uint64_t lead = cache->clock - issued_at;
+
+  cache->pf_stats->useful += 1;
+  cache->pf_stats->lead += lead;
+  if (lead < PREFETCH_LATE_DISTANCE)
+    cache->pf_stats->late += 1;
+}
+
+// a demand hit, returns whether it was the first use of a prefetched line
+static bool _cache_prefetch_hit(Cache* cache, const uint32_t tag, const uint32_t set) {
+  size_t way;
+
+  if (!cache->prefetched[set] || !_cache_find(cache, tag, set, &way) || !(cache->prefetched[set] & (1u << way)))
+    return false;
+
+  cache->prefetched[set] &= ~(1u << way);
+  _cache_prefetch_used(cache, cache->issued_at[set * cache->set_size + way]);
+  return true;
+}
+
+// fetches a line into a stream buffer
+static void _cache_prefetch_stream_fetch(Cache* cache, const uint32_t line) {
+  const uint32_t address = line << cache->decode.index_pos;
+
+  // the next level doesn't store unsampled sets either
+  if (!_cache_sampled(cache, address)) return;
+
+  cache->pf_stats->issued += 1;
+
+  // stream buffers only hold clean lines, a dirty one handed up goes straight back
+  if (_cache_readback(cache, address))
+    _cache_writeback(cache, address, false);
+}
+
+// a demand miss, returns whether a stream buffer had the line so it doesn't need to be read back
+static bool _cache_prefetch_miss(Cache* cache, const uint32_t address, const uint32_t set) {
+  const uint32_t line = address >> cache->decode.index_pos;
+  const size_t base = set * cache->set_size;
+
+  // a line some prefetch fill evicted
+  for (size_t way = 0; way < cache->set_size; way++) {
+    if (cache->polluters[base + way] != line + 1) continue;
+
+    cache->polluters[base + way] = 0;
+    cache->pf_stats->pollution += 1;
+    break;
   }
-  
-  // find an invalid block to replace
-  if (_cache_find_invalid(cache, index, &node)) {
-    memcpy((CacheEntry*) node->data, new_entry, sizeof(CacheEntry));
-    goto L_update_lru;
+
+  uint64_t fetched;
+  uint32_t refill;
+  if (prefetcher_stream_take(cache->prefetcher, line, cache->clock, &fetched, &refill)) {
+    _cache_prefetch_used(cache, fetched);
+    _cache_prefetch_stream_fetch(cache, refill);
+    return true;
+  }
+
+  cache->pf_stats->misses += 1;
+  return false;
+}
+
+// fills a line the prefetcher asked for unless it's already cached
+static void _cache_prefetch_fill(Cache* cache, const uint32_t line) {
+  const uint32_t address = line << cache->decode.index_pos;
+  uint32_t tag, index, set;
+  size_t way;
+
+  // lines of unsampled sets are never cached
+  if (!_cache_sampled(cache, address)) return;
+
+  _cache_decode(cache, address, &tag, &index);
+  set = _cache_set(cache, index);
+  if (_cache_find(cache, tag, set, &way)) return;
+  if (cache->victim && victim_holds(cache->victim, line)) return;
+
+  // an exclusive next level gives the line up before the fill evicts, see _cache_insert
+  const bool swap = cache->next && cache->next->inclusion == INCLUSION_EXCLUSIVE;
+  const bool dirty = swap && _cache_readback(cache, address);
+
+  // remember the line the fill pushes out, a later miss on it is pollution
+  const size_t base = set * cache->set_size;
+  if (!replacer_find_invalid(cache->replacer, set, cache->valid[set], &way)) {
+    way = _cache_evict(cache, set);
+    cache->polluters[base + way] = (_cache_address_from_tag_index(cache, cache->tags[base + way], _cache_index(cache, set)) >> cache->decode.index_pos) + 1;
+  }
+
+  cache->tags[base + way] = tag;
+  cache->valid[set] |= 1u << way;
+  if (dirty)
+    cache->dirty[set] |= 1u << way;
+  else
+    cache->dirty[set] &= ~(1u << way);
+  replacer_fill(cache->replacer, set, way);
+  _cache_stamp(cache, set, way);
+  if (cache->protocol != COHERENCE_NONE) {
+    bool supplied = false;
+    _cache_coherent_fill(cache, address, set, way, _cache_snoop(cache, address, false, &supplied));
+  }
+
+  cache->prefetched[set] |= 1u << way;
+  cache->issued_at[base + way] = cache->clock;
+  cache->pf_stats->issued += 1;
+  if (!swap && _cache_readback(cache, address))
+    cache->dirty[set] |= 1u << way;
+}
+
+// trains the prefetcher on a demand access and issues what it asks for.
+// the per-reference fields of this and the next level describe the demand access, not the prefetches.
+static void _cache_prefetch(Cache* cache, const uint32_t address, const bool trigger) {
+  uint32_t lines[PREFETCH_MAX_DEGREE];
+  size_t dropped;
+  size_t count = prefetcher_access(cache->prefetcher, address >> cache->decode.index_pos, trigger, cache->clock, lines, &dropped);
+
+  cache->pf_stats->unused += dropped;
+  if (!count) return;
+
+  CacheStats saved = *cache->stats;
+  CacheStats saved_next = cache->next ? *cache->next->stats : saved;
+  uint64_t saved_cycles = cache->cycles ? *cache->cycles : 0;
+
+  for (size_t i = 0; i < count; i++) {
+    if (cache->prefetcher->policy == PREFETCH_STREAM)
+      _cache_prefetch_stream_fetch(cache, lines[i]);
+    else
+      _cache_prefetch_fill(cache, lines[i]);
+  }
+
+  _cache_restore_reference(cache->stats, &saved);
+  if (cache->next) _cache_restore_reference(cache->next->stats, &saved_next);
+  if (cache->cycles) *cache->cycles = saved_cycles;
+}
+
+// MSHRS
+
+// a hit on a line whose miss is still outstanding merges into it
+static void _cache_mshr_hit(Cache* cache, const uint32_t address) {
+  if (mshr_pending(cache->mshr, address >> cache->decode.index_pos, cache->clock))
+    cache->mshr_stats->merged += 1;
+}
+
+static void _cache_mshr_miss(Cache* cache, const uint32_t address) {
+  uint32_t line = address >> cache->decode.index_pos;
+
+  // the line was evicted again before its miss finished
+  if (mshr_pending(cache->mshr, line, cache->clock)) {
+    cache->mshr_stats->merged += 1;
+    return;
   }
 
-  // evict the LRU
-  node = _cache_evict(cache, index);
-  memcpy((CacheEntry*) node->data, new_entry, sizeof(CacheEntry));
+  cache->mshr_stats->primary += 1;
+  if (!mshr_allocate(cache->mshr, line, cache->clock))
+    cache->mshr_stats->stalls += 1;
+  if (cache->mshr->count > cache->mshr_stats->peak)
+    cache->mshr_stats->peak = cache->mshr->count;
+}
 
-L_update_lru:
+// reads a missing line from the next level, `demand` misses hold an MSHR
+// returns whether the line came back dirty
+static bool _cache_fetch(Cache* cache, const uint32_t address, const bool demand) {
+  if (cache->mshr && demand)
+    _cache_mshr_miss(cache, address);
+  return _cache_readback(cache, address);
+}
 
-  if (update_lru)
-    Set_set_mru(cache->sets[index], node);
+// every access goes through the shadow cache, only misses are counted. the shadow cache only fills when the cache does
+static void _cache_classify(Cache* cache, const uint32_t address, const bool hit, const bool fill) {
+  const uint32_t line = address >> cache->decode.index_pos;
+  MissClass class = fill ? classifier_access(cache->classifier, line) : classifier_probe(cache->classifier, line);
+  if (hit) return;
 
-  return hit;
+  switch (class) {
+    case MISS_COMPULSORY:
+      cache->miss_stats->compulsory += 1;
+      break;
+    case MISS_CAPACITY:
+      cache->miss_stats->capacity += 1;
+      break;
+    case MISS_CONFLICT:
+      cache->miss_stats->conflict += 1;
+      break;
+  }
 }
 
+// a miss served by the victim cache or a stream buffer, the line takes another access to move in
+static void _cache_buffered(Cache* cache) {
+  cache->stats->buffered = true;
+  if (cache->cycles) *cache->cycles += cache->latency;
+}
 
-void cache_read(Cache* cache, const uint32_t address) {
+bool cache_read(Cache* cache, const uint32_t address) {
   uint32_t tag, index;
+  size_t way;
+  bool supplied = false;
+  bool fetched = false;
+  bool handed_dirty = false;
+
+  // an exclusive cache doesn't fill on the way up, its lines move up on a hit
+  const bool exclusive = cache->inclusion == INCLUSION_EXCLUSIVE;
   
   _cache_decode(cache, address, &tag, &index);
+  uint32_t set = _cache_set(cache, index);
 
-  CacheEntry entry;
-  entry.tag = tag;
-  entry.valid = true;
-  entry.dirty = false;
+  cache->clock += 1;
+  if (cache->cycles) *cache->cycles += cache->latency;
+  cache->stats->buffered = false;
+  if (cache->instrumented)
+    _cache_reuse(cache, tag, set);
+  if (exclusive)
+    cache->stats->hit = _cache_find(cache, tag, set, &way);
+  else
+    cache->stats->hit = _cache_insert(cache, tag, set, false, true, true, &supplied, &fetched);
+  cache->set_accesses[set] += 1;
+  if (cache->classifier)
+    _cache_classify(cache, address, cache->stats->hit, !exclusive);
 
-  cache->stats->hit = _cache_insert(cache, tag, index, &entry, true);
-  if (cache->stats->hit) 
+  // a miss or the first use of a prefetched line
+  bool trigger = !cache->stats->hit;
+  if (cache->stats->hit) {
     cache->stats->hits += 1;
-  else
-    _cache_readback(cache, address);
+    if (cache->prefetcher)
+      trigger = _cache_prefetch_hit(cache, tag, set);
+    if (cache->mshr)
+      _cache_mshr_hit(cache, address);
+
+    if (exclusive) {
+      handed_dirty = cache->dirty[set] & (1u << way);
+      cache->valid[set] &= ~(1u << way);
+      _cache_drop_prefetch(cache, set, way);
+      if (cache->classifier)
+        classifier_evict(cache->classifier, address >> cache->decode.index_pos);
+    }
+  } else {
+    cache->set_misses[set] += 1;
+    if (supplied) {
+      _cache_buffered(cache);
+    } else if (cache->prefetcher && _cache_prefetch_miss(cache, address, set)) {
+      // a line from a stream buffer doesn't start another stream
+      _cache_buffered(cache);
+      trigger = false;
+    } else if (!fetched && _cache_fetch(cache, address, true)) {
+      // an exclusive next level handed up its dirty copy
+      if (exclusive)
+        handed_dirty = true;
+      else
+        _cache_mark_dirty(cache, tag, set);
+    }
+  }
     
   cache->stats->address = address;
   cache->stats->tag = tag;
@@ -318,54 +1196,170 @@ void cache_read(Cache* cache, const uint32_t address) {
   cache->stats->type = CACHE_READ;
   cache->stats->show = true;
   cache->stats->reads += 1;
+
+  if (cache->prefetcher)
+    _cache_prefetch(cache, address, trigger);
+
+  return handed_dirty;
 }
 
 void cache_write(Cache* cache, const uint32_t address, bool update_lru) {
   uint32_t tag, index;
-  SetNode* node;
+  size_t way;
+  bool supplied, fetched;
   
   _cache_decode(cache, address, &tag, &index);
 
+  if (update_lru) {
+    cache->clock += 1;
+    cache->stats->buffered = false;
+  }
+  if (cache->cycles) *cache->cycles += cache->latency;
   cache->stats->total_accesses += 1;
   cache->stats->type = CACHE_WRITE;
   cache->stats->tag = tag;
   cache->stats->index = index;
 
-  Set* set = cache->sets[index];
+  uint32_t set = _cache_set(cache, index);
+  cache->set_accesses[set] += 1;
+  if (cache->instrumented)
+    _cache_reuse(cache, tag, set);
 
   // hit
-  cache->stats->hit = _cache_find(cache, tag, index, &node);
+  cache->stats->hit = _cache_find(cache, tag, set, &way);
+  // an exclusive cache lets writes through to lines the levels above hold, it only takes their evictions
+  const bool allocate = cache->write_miss_policy == WRALLOC && !(cache->inclusion == INCLUSION_EXCLUSIVE && update_lru);
+  if (cache->classifier)
+    _cache_classify(cache, address, cache->stats->hit, allocate);
+
+  // only demand writes train the prefetcher, not writebacks from the previous level
+  bool train = cache->prefetcher && update_lru;
 
   if (cache->stats->hit) {
-    Set_set_mru(set, node);
+    replacer_touch(cache->replacer, set, way);
+    if (cache->protocol != COHERENCE_NONE && (cache->shared[set] & (1u << way)))
+      _cache_upgrade(cache, address, set, way);
    
     // action based on WRITE MODE
     if (cache->write_policy == WRITE_THROUGH)
       _cache_writeback(cache, address, update_lru);
-    else {
-      CacheEntry* entry = (CacheEntry*) node->data;
-      entry->dirty = true;
-    }
+    else
+      cache->dirty[set] |= 1u << way;
 
     // update stats
     cache->stats->hits += 1;
     if (update_lru)
       cache->stats->show = true;
 
+    if (train)
+      _cache_prefetch(cache, address, _cache_prefetch_hit(cache, tag, set));
+    if (cache->mshr && update_lru)
+      _cache_mshr_hit(cache, address);
     return;
   }
 
   // miss
-  if (cache->write_miss_policy == NO_WRALLOC) {
+  bool trigger = true;
+  cache->set_misses[set] += 1;
+  if (!allocate) {
+    if (cache->protocol != COHERENCE_NONE)
+      _cache_snoop(cache, address, true, &supplied);
     _cache_writeback(cache, address, update_lru);
   } else {
-    CacheEntry entry;
-    entry.tag = tag;
-    entry.valid = true;
-    entry.dirty = true;
-    
-    // this sets MRU for us
-    _cache_insert(cache, tag, index, &entry, true);
-    _cache_readback(cache, address);
+    // this fills the replacement state for us
+    _cache_insert(cache, tag, set, true, true, update_lru, &supplied, &fetched);
+    if (supplied) {
+      _cache_buffered(cache);
+    } else if (train && _cache_prefetch_miss(cache, address, set)) {
+      _cache_buffered(cache);
+      trigger = false;
+    } else if (!fetched) {
+      _cache_fetch(cache, address, update_lru);
+    }
+  }
+
+  if (train)
+    _cache_prefetch(cache, address, trigger);
+}
+
+// SNAPSHOTS
+
+// saves and loads go through the same list of fields, `io` either writes or reads each one
+static bool _cache_snapshot(Cache* cache, FILE* f, bool (*io)(FILE*, void*, size_t)) {
+  const size_t sets = cache->stored_sets;
+  const size_t lines = sets * cache->set_size;
+
+  if (!io(f, cache->tags, sizeof(uint32_t) * lines)
+      || !io(f, cache->valid, sizeof(uint32_t) * sets)
+      || !io(f, cache->dirty, sizeof(uint32_t) * sets)
+      || !io(f, cache->set_accesses, sizeof(uint64_t) * sets)
+      || !io(f, cache->set_misses, sizeof(uint64_t) * sets)
+      || !io(f, &cache->clock, sizeof(cache->clock))
+      || !io(f, cache->stats, sizeof(CacheStats)))
+    return false;
+
+  if (cache->prefetcher && (!io(f, cache->pf_stats, sizeof(PrefetchStats))
+      || !io(f, cache->prefetched, sizeof(uint32_t) * sets)
+      || !io(f, cache->issued_at, sizeof(uint64_t) * lines)
+      || !io(f, cache->polluters, sizeof(uint32_t) * lines)))
+    return false;
+
+  if (cache->victim && !io(f, cache->victim_stats, sizeof(VictimStats)))
+    return false;
+  if (cache->mshr && !io(f, cache->mshr_stats, sizeof(MSHRStats)))
+    return false;
+
+  if (cache->protocol != COHERENCE_NONE && (!io(f, cache->coherence_stats, sizeof(CoherenceStats))
+      || !io(f, cache->shared, sizeof(uint32_t) * sets)
+      || !io(f, cache->stolen, sizeof(uint32_t) * lines)))
+    return false;
+
+  if (cache->classifier && !io(f, cache->miss_stats, sizeof(MissStats)))
+    return false;
+
+  if (cache->instrumented && (!io(f, cache->reuse_stats, sizeof(ReuseStats))
+      || !io(f, &cache->reuse_clock, sizeof(cache->reuse_clock))
+      || !io(f, cache->last_use, sizeof(uint64_t) * lines)))
+    return false;
+
+  return true;
+}
+
+static bool _cache_write(FILE* f, void* data, size_t size) {
+  return snapshot_write(f, data, size);
+}
+
+static bool _cache_read(FILE* f, void* data, size_t size) {
+  return snapshot_read(f, data, size);
+}
+
+bool cache_save(const Cache* cache, FILE* f) {
+  return _cache_snapshot((Cache*) cache, f, _cache_write)
+    && replacer_save(cache->replacer, f)
+    && (!cache->prefetcher || prefetcher_save(cache->prefetcher, f))
+    && (!cache->victim || victim_save(cache->victim, f))
+    && (!cache->mshr || mshr_save(cache->mshr, f))
+    && (!cache->classifier || classifier_save(cache->classifier, f));
+}
+
+// lines can only be valid, dirty, prefetched or shared in ways the sets have
+static bool _cache_ways_ok(const Cache* cache) {
+  const uint32_t ways = (uint32_t) ~(~0ull << cache->set_size);
+
+  for (size_t set = 0; set < cache->stored_sets; set++) {
+    if ((cache->valid[set] | cache->dirty[set]) & ~ways) return false;
+    if (cache->prefetcher && (cache->prefetched[set] & ~ways)) return false;
+    if (cache->protocol != COHERENCE_NONE && (cache->shared[set] & ~ways)) return false;
   }
+  return true;
+}
+
+bool cache_load(Cache* cache, FILE* f) {
+  return _cache_snapshot(cache, f, _cache_read)
+    && _cache_ways_ok(cache)
+    && replacer_load(cache->replacer, f)
+    && (!cache->prefetcher || prefetcher_load(cache->prefetcher, f))
+    && (!cache->victim || victim_load(cache->victim, f))
+    && (!cache->mshr || mshr_load(cache->mshr, f))
+    && (!cache->classifier || classifier_load(cache->classifier, f));
 }
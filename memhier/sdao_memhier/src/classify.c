@@ -0,0 +1,238 @@
+#include <stdlib.h>
+#include "classify.h"
+#include "snapshot.h"
+
+#define CLASSIFIER_NONE UINT32_MAX
+
+#define BLOCK_WORDS (CLASSIFIER_BLOCK_LINES / 64)
+
+MissClassifier* classifier_new(const size_t capacity, const size_t line_bits) {
+  MissClassifier* classifier = calloc(1, sizeof(MissClassifier));
+  classifier->capacity = capacity;
+
+  uint64_t lines = 1ull << line_bits;
+  classifier->num_blocks = (lines + CLASSIFIER_BLOCK_LINES - 1) / CLASSIFIER_BLOCK_LINES;
+  classifier->touched = calloc(classifier->num_blocks, sizeof(uint64_t*));
+
+  size_t entries = 2;
+  while (entries < capacity * 2) entries *= 2;
+  classifier->table_mask = entries - 1;
+  classifier->table = calloc(entries, sizeof(ClassifierEntry));
+
+  classifier->nodes = calloc(capacity, sizeof(ClassifierNode));
+  classifier->head = classifier->tail = CLASSIFIER_NONE;
+
+  return classifier;
+}
+
+void classifier_free(MissClassifier* classifier) {
+  for (size_t i = 0; i < classifier->num_blocks; i++)
+    free(classifier->touched[i]);
+  free(classifier->touched);
+  free(classifier->table);
+  free(classifier->nodes);
+  free(classifier);
+}
+
+// sets the bit of `line`, returns whether it was clear
+static bool _classifier_first_touch(MissClassifier* classifier, const uint32_t line) {
+  uint64_t** block = classifier->touched + line / CLASSIFIER_BLOCK_LINES;
+  if (!*block) *block = calloc(BLOCK_WORDS, sizeof(uint64_t));
+
+  uint64_t* word = *block + (line % CLASSIFIER_BLOCK_LINES) / 64;
+  uint64_t bit = 1ull << (line % 64);
+  if (*word & bit) return false;
+
+  *word |= bit;
+  return true;
+}
+
+// where `line` hashes to
+static inline size_t _classifier_home(const MissClassifier* classifier, const uint32_t line) {
+  return (size_t)(((uint64_t) line * 0x9E3779B97F4A7C15ull) >> 32) & classifier->table_mask;
+}
+
+// the entry holding `line`, or the empty one it would go in
+static size_t _classifier_find(const MissClassifier* classifier, const uint32_t line) {
+  size_t i = _classifier_home(classifier, line);
+
+  while (classifier->table[i].node && classifier->table[i].line != line)
+    i = (i + 1) & classifier->table_mask;
+
+  return i;
+}
+
+// empties entry `i`, moving later entries of the run back so every line stays reachable from its home
+static void _classifier_remove(MissClassifier* classifier, size_t i) {
+  const size_t mask = classifier->table_mask;
+  size_t j = i;
+
+  classifier->table[i].node = 0;
+  while (true) {
+    j = (j + 1) & mask;
+    if (!classifier->table[j].node) return;
+
+    // an entry can move back to `i` when its home isn't in (i, j]
+    size_t home = _classifier_home(classifier, classifier->table[j].line);
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      classifier->table[i] = classifier->table[j];
+      classifier->table[j].node = 0;
+      i = j;
+    }
+  }
+}
+
+static void _classifier_unlink(MissClassifier* classifier, const uint32_t node) {
+  ClassifierNode* nodes = classifier->nodes;
+  uint32_t prev = nodes[node].prev;
+  uint32_t next = nodes[node].next;
+
+  if (prev != CLASSIFIER_NONE) nodes[prev].next = next;
+  else classifier->head = next;
+  if (next != CLASSIFIER_NONE) nodes[next].prev = prev;
+  else classifier->tail = prev;
+}
+
+static void _classifier_push(MissClassifier* classifier, const uint32_t node) {
+  ClassifierNode* nodes = classifier->nodes;
+
+  nodes[node].prev = CLASSIFIER_NONE;
+  nodes[node].next = classifier->head;
+  if (classifier->head != CLASSIFIER_NONE) nodes[classifier->head].prev = node;
+  else classifier->tail = node;
+  classifier->head = node;
+}
+
+// brings `line` into the shadow cache as its MRU line, evicting the LRU one when full
+static void _classifier_fill(MissClassifier* classifier, const uint32_t line) {
+  uint32_t node;
+
+  if (classifier->used < classifier->capacity) {
+    node = classifier->used++;
+  } else {
+    node = classifier->tail;
+    _classifier_unlink(classifier, node);
+    _classifier_remove(classifier, _classifier_find(classifier, classifier->nodes[node].line));
+  }
+
+  // the eviction may have moved entries, so look again
+  size_t i = _classifier_find(classifier, line);
+  classifier->table[i].line = line;
+  classifier->table[i].node = node + 1;
+  classifier->nodes[node].line = line;
+  _classifier_push(classifier, node);
+}
+
+// makes `line` the MRU line, returns whether the shadow cache holds it
+static bool _classifier_touch(MissClassifier* classifier, const uint32_t line) {
+  size_t i = _classifier_find(classifier, line);
+  if (!classifier->table[i].node) return false;
+
+  uint32_t node = classifier->table[i].node - 1;
+  if (node != classifier->head) {
+    _classifier_unlink(classifier, node);
+    _classifier_push(classifier, node);
+  }
+  return true;
+}
+
+MissClass classifier_access(MissClassifier* classifier, const uint32_t line) {
+  if (_classifier_touch(classifier, line)) return MISS_CONFLICT;
+
+  _classifier_fill(classifier, line);
+  return _classifier_first_touch(classifier, line) ? MISS_COMPULSORY : MISS_CAPACITY;
+}
+
+MissClass classifier_probe(MissClassifier* classifier, const uint32_t line) {
+  if (_classifier_touch(classifier, line)) return MISS_CONFLICT;
+
+  return _classifier_first_touch(classifier, line) ? MISS_COMPULSORY : MISS_CAPACITY;
+}
+
+void classifier_evict(MissClassifier* classifier, const uint32_t line) {
+  size_t i = _classifier_find(classifier, line);
+  if (!classifier->table[i].node) return;
+
+  uint32_t node = classifier->table[i].node - 1;
+  _classifier_unlink(classifier, node);
+  _classifier_remove(classifier, i);
+
+  // the last node handed out moves into the freed one so nodes stay packed
+  uint32_t last = --classifier->used;
+  if (node == last) return;
+
+  ClassifierNode* nodes = classifier->nodes;
+  nodes[node] = nodes[last];
+  if (nodes[node].prev != CLASSIFIER_NONE) nodes[nodes[node].prev].next = node;
+  else classifier->head = node;
+  if (nodes[node].next != CLASSIFIER_NONE) nodes[nodes[node].next].prev = node;
+  else classifier->tail = node;
+  classifier->table[_classifier_find(classifier, nodes[node].line)].node = node + 1;
+}
+
+// SNAPSHOTS
+
+// a loaded shadow cache has to be one classifier_save could have written: the list runs from head to tail
+// through exactly the `used` nodes handed out, and the table holds those nodes and nothing else
+static bool _classifier_ok(const MissClassifier* classifier) {
+  const ClassifierNode* nodes = classifier->nodes;
+  const size_t used = classifier->used;
+  uint32_t prev = CLASSIFIER_NONE;
+  uint32_t node = classifier->head;
+  size_t entries = 0;
+
+  for (size_t i = 0; i < used; i++) {
+    if (node >= used || nodes[node].prev != prev) return false;
+    prev = node;
+    node = nodes[node].next;
+  }
+  if (node != CLASSIFIER_NONE || classifier->tail != prev) return false;
+
+  for (size_t i = 0; i <= classifier->table_mask; i++) {
+    const ClassifierEntry* entry = classifier->table + i;
+    if (!entry->node) continue;
+    if (entry->node > used || nodes[entry->node - 1].line != entry->line) return false;
+    entries += 1;
+  }
+  if (entries != used) return false;
+
+  // each node's line has to be found where the lookups will look for it
+  for (uint32_t i = 0; i < used; i++) {
+    if (classifier->table[_classifier_find(classifier, nodes[i].line)].node != i + 1) return false;
+  }
+
+  return true;
+}
+
+bool classifier_save(const MissClassifier* classifier, FILE* f) {
+  for (size_t i = 0; i < classifier->num_blocks; i++) {
+    uint8_t present = classifier->touched[i] != NULL;
+    if (!snapshot_write(f, &present, sizeof(present))) return false;
+    if (present && !snapshot_write(f, classifier->touched[i], sizeof(uint64_t) * BLOCK_WORDS)) return false;
+  }
+
+  return snapshot_write(f, classifier->table, sizeof(ClassifierEntry) * (classifier->table_mask + 1))
+    && snapshot_write(f, &classifier->used, sizeof(classifier->used))
+    && snapshot_write(f, classifier->nodes, sizeof(ClassifierNode) * classifier->capacity)
+    && snapshot_write(f, &classifier->head, sizeof(classifier->head))
+    && snapshot_write(f, &classifier->tail, sizeof(classifier->tail));
+}
+
+bool classifier_load(MissClassifier* classifier, FILE* f) {
+  for (size_t i = 0; i < classifier->num_blocks; i++) {
+    uint8_t present;
+    if (!snapshot_read(f, &present, sizeof(present)) || present > 1) return false;
+    if (!present) continue;
+
+    if (!classifier->touched[i]) classifier->touched[i] = calloc(BLOCK_WORDS, sizeof(uint64_t));
+    if (!snapshot_read(f, classifier->touched[i], sizeof(uint64_t) * BLOCK_WORDS)) return false;
+  }
+
+  return snapshot_read(f, classifier->table, sizeof(ClassifierEntry) * (classifier->table_mask + 1))
+    && snapshot_read(f, &classifier->used, sizeof(classifier->used))
+    && classifier->used <= classifier->capacity
+    && snapshot_read(f, classifier->nodes, sizeof(ClassifierNode) * classifier->capacity)
+    && snapshot_read(f, &classifier->head, sizeof(classifier->head))
+    && snapshot_read(f, &classifier->tail, sizeof(classifier->tail))
+    && _classifier_ok(classifier);
+}
@@ -5,6 +5,17 @@
 #include "config_consts.h"
 #include "util.h"
 
+// prints an optional cache block the way the dc and L2 blocks are printed
+void print_level(const LevelConfig* level, const char* name, const bool write_line) {
+  printf("%s-cache contains %lu sets.\n", name, level->num_sets);
+  printf("Each set contains %lu entries.\n", level->set_size);
+  printf("Each line is %lu bytes.\n", level->line_size);
+  if (write_line)
+    printf("The cache uses a %s policy.\n", level->write ? "no write-allocate and write-through" : "write-allocate and write-back");
+  printf("Number of bits used for the index is %lu.\n", log_2(level->num_sets));
+  printf("Number of bits used for the offset is %lu.\n\n", log_2(level->line_size));
+}
+
 void print_config(const Config* config) {
   printf("Data TLB contains %lu sets.\n", config->tlb_num_sets);
   printf("Each set contains %lu entries.\n", config->tlb_set_size);
@@ -30,12 +41,61 @@ void print_config(const Config* config) {
   printf("Number of bits used for the index is %lu.\n", log_2(config->L2_num_sets));
   printf("Number of bits used for the offset is %lu.\n\n", log_2(config->L2_line_size));
 
+  if (config->use_L1I)
+    print_level(&config->L1I, "I", false);
+  for (size_t i = 0; i < config->num_lower; i++) {
+    char name[24];
+    snprintf(name, sizeof(name), "L%lu", i + 3);
+    print_level(config->lower + i, name, true);
+  }
+
   printf("The addresses read in are %s addresses.\n", config->virtual_addresses ? "virtual" : "physical");
   if (!config->use_tlb)
     printf("TLB is disabled in this configuration.\n");
   if (!config->use_L2)
     printf("L2 cache is disabled in this configuration.\n");
 
+  // only mention replacement when it isn't the default
+  if (config->tlb_replacement != REPLACE_LRU)
+    printf("The TLB uses %s replacement.\n", replacement_policy_name(config->tlb_replacement));
+  if (config->dc_replacement != REPLACE_LRU)
+    printf("The D-cache uses %s replacement.\n", replacement_policy_name(config->dc_replacement));
+  if (config->L2_replacement != REPLACE_LRU)
+    printf("The L2-cache uses %s replacement.\n", replacement_policy_name(config->L2_replacement));
+  if (config->pt_replacement != PAGE_LRU)
+    printf("The page table uses %s replacement.\n", page_policy_name(config->pt_replacement));
+  if (config->pt_type != PTABLE_FLAT)
+    printf("The page table is a %s table of %lu bit virtual addresses.\n", page_table_type_name(config->pt_type), config->pt_address_bits);
+  if (config->dc_prefetch != PREFETCH_NONE)
+    printf("The D-cache uses a %s prefetcher of degree %lu.\n", prefetch_policy_name(config->dc_prefetch), config->dc_prefetch_degree);
+  if (config->L2_prefetch != PREFETCH_NONE)
+    printf("The L2-cache uses a %s prefetcher of degree %lu.\n", prefetch_policy_name(config->L2_prefetch), config->L2_prefetch_degree);
+  if (config->dc_victim_entries)
+    printf("The D-cache has a %lu entry victim cache.\n", config->dc_victim_entries);
+  if (config->dc_mshr_entries)
+    printf("The D-cache has %lu MSHRs, misses are outstanding for %lu accesses.\n", config->dc_mshr_entries, config->dc_mshr_miss_time);
+  if (config->timing)
+    printf("Latencies are %lu (TLB), %lu (page walk), %lu (D-cache), %lu (L2-cache), %lu (memory) and %lu (disk) cycles.\n",
+      config->tlb_latency, config->walk_latency, config->dc_latency, config->L2_latency, config->memory_latency, config->disk_latency);
+  if (config->timing && config->use_L1I)
+    printf("The I-cache takes %lu cycles.\n", config->L1I.latency);
+  for (size_t i = 0; i < config->num_lower; i++) {
+    if (config->timing)
+      printf("The L%lu-cache takes %lu cycles.\n", i + 3, config->lower[i].latency);
+  }
+  if (config->L2_inclusion != INCLUSION_INCLUSIVE)
+    printf("The L2-cache is %s.\n", inclusion_policy_name(config->L2_inclusion));
+  for (size_t i = 0; i < config->num_lower; i++) {
+    if (config->lower[i].inclusion != INCLUSION_INCLUSIVE)
+      printf("The L%lu-cache is %s.\n", i + 3, inclusion_policy_name(config->lower[i].inclusion));
+  }
+  if (config->dc_classify)
+    printf("The D-cache misses are classified as compulsory, capacity or conflict misses.\n");
+  if (config->L2_classify)
+    printf("The L2-cache misses are classified as compulsory, capacity or conflict misses.\n");
+  if (config->cores > 1)
+    printf("There are %lu cores with private D-caches kept coherent with %s.\n", config->cores, coherence_protocol_name(config->coherence));
+
   fputc('\n', stdout);
 }
 
@@ -61,10 +121,71 @@ void debug_config(const Config* config) {
   printf("\tLine size: %lu\n", config->L2_line_size);
   printf("\tWrite through/no write allocate: %c\n\n", config->L2_write ? 'y' : 'n');
 
+  if (config->use_L1I) {
+    printf("Instruction Cache configuration\n");
+    printf("\tNumber of sets: %lu\n", config->L1I.num_sets);
+    printf("\tSet size: %lu\n", config->L1I.set_size);
+    printf("\tLine size: %lu\n\n", config->L1I.line_size);
+  }
+
+  for (size_t i = 0; i < config->num_lower; i++) {
+    printf("L%lu Cache configuration\n", i + 3);
+    printf("\tNumber of sets: %lu\n", config->lower[i].num_sets);
+    printf("\tSet size: %lu\n", config->lower[i].set_size);
+    printf("\tLine size: %lu\n", config->lower[i].line_size);
+    printf("\tWrite through/no write allocate: %c\n\n", config->lower[i].write ? 'y' : 'n');
+  }
+
   printf("Toggles\n");
   printf("\tVirtual addresses: %c\n", config->virtual_addresses ? 'y' : 'n');
   printf("\tTLB: %c\n", config->use_tlb ? 'y' : 'n');
   printf("\tL2: %c\n\n", config->use_L2 ? 'y' : 'n');
+
+  printf("Replacement policies\n");
+  printf("\tTLB: %s\n", replacement_policy_name(config->tlb_replacement));
+  printf("\tDC: %s\n", replacement_policy_name(config->dc_replacement));
+  printf("\tL2: %s\n", replacement_policy_name(config->L2_replacement));
+  printf("\tPT: %s\n\n", page_policy_name(config->pt_replacement));
+
+  printf("Page table organization\n");
+  printf("\tType: %s\n", page_table_type_name(config->pt_type));
+  printf("\tVirtual address bits: %lu\n\n", config->pt_address_bits);
+
+  printf("Prefetchers\n");
+  printf("\tDC: %s %lu\n", prefetch_policy_name(config->dc_prefetch), config->dc_prefetch_degree);
+  printf("\tL2: %s %lu\n\n", prefetch_policy_name(config->L2_prefetch), config->L2_prefetch_degree);
+
+  printf("Victim cache and MSHRs\n");
+  printf("\tVictim entries: %lu\n", config->dc_victim_entries);
+  printf("\tMSHR entries: %lu\n", config->dc_mshr_entries);
+  printf("\tMSHR miss time: %lu\n\n", config->dc_mshr_miss_time);
+
+  printf("Latencies%s\n", config->timing ? "" : " (not timed)");
+  printf("\tTLB: %lu\n", config->tlb_latency);
+  printf("\tPage walk: %lu\n", config->walk_latency);
+  printf("\tDC: %lu\n", config->dc_latency);
+  printf("\tL2: %lu\n", config->L2_latency);
+  printf("\tMemory: %lu\n", config->memory_latency);
+  printf("\tDisk: %lu\n", config->disk_latency);
+  if (config->use_L1I)
+    printf("\tL1I: %lu\n", config->L1I.latency);
+  for (size_t i = 0; i < config->num_lower; i++)
+    printf("\tL%lu: %lu\n", i + 3, config->lower[i].latency);
+  fputc('\n', stdout);
+
+  printf("Inclusion policies\n");
+  printf("\tL2: %s\n", inclusion_policy_name(config->L2_inclusion));
+  for (size_t i = 0; i < config->num_lower; i++)
+    printf("\tL%lu: %s\n", i + 3, inclusion_policy_name(config->lower[i].inclusion));
+  fputc('\n', stdout);
+
+  printf("Multi-core\n");
+  printf("\tCores: %lu\n", config->cores);
+  printf("\tProtocol: %s\n\n", coherence_protocol_name(config->coherence));
+
+  printf("Miss classification\n");
+  printf("\tDC: %c\n", config->dc_classify ? 'y' : 'n');
+  printf("\tL2: %c\n\n", config->L2_classify ? 'y' : 'n');
 }
 
 void free_config(Config* config) {
@@ -75,6 +196,25 @@ bool is_power2(size_t n) {
   return n != 0 && (n & (n - 1)) == 0;
 }
 
+// checks an optional cache block, its line size has to be between `min_line` and `max_line`
+bool validate_level(const LevelConfig* level, const char* name, const size_t min_line, const size_t max_line) {
+  if (!is_power2(level->num_sets) || !is_power2(level->set_size) || !is_power2(level->line_size)) {
+    fprintf(stderr, "%s Number of sets, set size and line size should be powers of 2.\n", name);
+    return false;
+  } else if (level->set_size > MAX_ASSOCIATIVITY) {
+    fprintf(stderr, "Max set size (associativity) is %lu.\n", MAX_ASSOCIATIVITY);
+    return false;
+  } else if (level->line_size < min_line || level->line_size > max_line) {
+    fprintf(stderr, "%s Line size should be at least %lu and at most the line size of the levels below.\n", name, min_line);
+    return false;
+  } else if (log_2(level->num_sets) + log_2(level->line_size) > 32) {
+    fprintf(stderr, "%s has more sets and line bytes than 32 bit addresses can index.\n", name);
+    return false;
+  }
+
+  return true;
+}
+
 bool validate_config(const Config* config) {
   // MAX TLB sets
   if (config->tlb_num_sets > TLB_MAX_SETS) {
@@ -150,6 +290,222 @@ bool validate_config(const Config* config) {
     return false;
   }
 
+  // radix and hashed tables cover the whole virtual address width instead of pt_num_vpages
+  if (config->pt_type != PTABLE_FLAT) {
+    size_t min_bits = log_2(config->pt_page_size) + (config->pt_type == PTABLE_RADIX ? PTABLE_RADIX_LEVELS : 1);
+    if (config->pt_address_bits < min_bits || config->pt_address_bits > MAX_ADDR_LEN) {
+      fprintf(stderr, "PAGE TABLE Virtual address bits should be between %lu and %lu.\n", min_bits, MAX_ADDR_LEN);
+      return false;
+    }
+  }
+
+  if (config->dc_prefetch_degree < 1 || config->dc_prefetch_degree > PREFETCH_MAX_DEGREE ||
+      config->L2_prefetch_degree < 1 || config->L2_prefetch_degree > PREFETCH_MAX_DEGREE) {
+    fprintf(stderr, "Prefetch degree should be between 1 and %u.\n", PREFETCH_MAX_DEGREE);
+    return false;
+  } else if (config->dc_victim_entries > VICTIM_MAX_ENTRIES) {
+    fprintf(stderr, "Victim entries should be at most %u.\n", VICTIM_MAX_ENTRIES);
+    return false;
+  } else if (config->dc_mshr_entries > MSHR_MAX_ENTRIES) {
+    fprintf(stderr, "MSHR entries should be at most %u.\n", MSHR_MAX_ENTRIES);
+    return false;
+  } else if (config->dc_mshr_entries && !config->dc_mshr_miss_time) {
+    fprintf(stderr, "MSHR miss time should be at least 1.\n");
+    return false;
+  }
+
+  if ((config->use_L1I || config->num_lower) && !config->use_L2) {
+    fprintf(stderr, "The I-cache and the levels below the L2 need the L2.\n");
+    return false;
+  } else if (config->use_L1I && !validate_level(&config->L1I, "I-cache", MIN_LINE_SIZE, config->L2_line_size)) {
+    return false;
+  }
+
+  // every level's lines are at least as large as the ones of the level above
+  for (size_t i = 0; i < config->num_lower; i++) {
+    char name[24];
+    snprintf(name, sizeof(name), "L%lu", i + 3);
+    if (!validate_level(config->lower + i, name, i ? config->lower[i - 1].line_size : config->L2_line_size, SIZE_MAX))
+      return false;
+  }
+
+  // an exclusive level swaps whole lines with the levels above, so their lines have to be the same size.
+  // it doesn't fill, so it can't take prefetches either
+  if (config->L2_inclusion == INCLUSION_EXCLUSIVE) {
+    if (config->dc_line_size != config->L2_line_size || (config->use_L1I && config->L1I.line_size != config->L2_line_size)) {
+      fprintf(stderr, "An exclusive L2 needs the line size of the dc (and I-cache).\n");
+      return false;
+    } else if (config->L2_prefetch != PREFETCH_NONE) {
+      fprintf(stderr, "An exclusive L2 can't have a prefetcher.\n");
+      return false;
+    } else if (config->dc_prefetch == PREFETCH_STREAM) {
+      // stream buffers would take lines out of the L2 and drop them unused
+      fprintf(stderr, "The dc can't use stream buffers above an exclusive L2.\n");
+      return false;
+    }
+  }
+
+  if (config->num_lower && config->lower[0].inclusion == INCLUSION_EXCLUSIVE && config->L2_prefetch == PREFETCH_STREAM) {
+    fprintf(stderr, "The L2 can't use stream buffers above an exclusive L3.\n");
+    return false;
+  }
+  for (size_t i = 0; i < config->num_lower; i++) {
+    size_t above = i ? config->lower[i - 1].line_size : config->L2_line_size;
+    if (config->lower[i].inclusion == INCLUSION_EXCLUSIVE && config->lower[i].line_size != above) {
+      fprintf(stderr, "An exclusive L%lu needs the line size of the level above.\n", i + 3);
+      return false;
+    }
+  }
+
+  if (config->cores < 1 || config->cores > MAX_CORES) {
+    fprintf(stderr, "Cores should be between 1 and %lu.\n", MAX_CORES);
+    return false;
+  } else if (config->cores > 1 && !config->use_L2) {
+    fprintf(stderr, "More than one core needs the L2 the dcs share.\n");
+    return false;
+  } else if (config->cores > 1 && config->dc_victim_entries) {
+    fprintf(stderr, "More than one core can't be combined with a victim cache.\n");
+    return false;
+  }
+
+  if (config->L2_classify && !config->use_L2) {
+    fprintf(stderr, "L2 miss classification needs the L2.\n");
+    return false;
+  }
+
+  return true;
+}
+
+// reads one "<structure>: <policy>" line of the replacement policy section
+bool read_replacement(FILE* f, char** buf, size_t* buf_size, const char* structure, ReplacementPolicy* policy, const int line) {
+  char label[8];
+  char name[16];
+
+  if (getline(buf, buf_size, f) == -1 || sscanf(*buf, "%7[^:]: %15s", label, name) != 2 ||
+      strcmp(label, structure) || !replacement_policy_parse(name, policy)) {
+    fprintf(stderr, "Expected \"%s: <lru,plru,srrip,brrip,fifo,random>\" on line %d.\n", structure, line);
+    return false;
+  }
+
+  return true;
+}
+
+// reads one "<structure>: <prefetcher>[ <degree>]" line of the prefetcher section
+bool read_prefetcher(FILE* f, char** buf, size_t* buf_size, const char* structure, PrefetchPolicy* policy, size_t* degree, const int line) {
+  char label[8];
+  char name[16];
+
+  *degree = 1;
+  if (getline(buf, buf_size, f) == -1 || sscanf(*buf, "%7[^:]: %15s %lu", label, name, degree) < 2 ||
+      strcmp(label, structure) || !prefetch_policy_parse(name, policy)) {
+    fprintf(stderr, "Expected \"%s: <none,next-line,stride,stream> [degree]\" on line %d.\n", structure, line);
+    return false;
+  }
+
+  return true;
+}
+
+// reads the lines of an optional cache block after its header, the write policy line only when `write_line` is set
+bool read_cache_block(FILE* f, char** buf, size_t* buf_size, LevelConfig* level, const bool write_line, const int line) {
+  char c = 'n';
+
+  if (getline(buf, buf_size, f) == -1 || sscanf(*buf, "Number of sets: %lu", &level->num_sets) != 1) {
+    fprintf(stderr, "Expected \"Number of sets: <num>\" on line %d.\n", line);
+    return false;
+  }
+
+  if (getline(buf, buf_size, f) == -1 || sscanf(*buf, "Set size: %lu", &level->set_size) != 1) {
+    fprintf(stderr, "Expected \"Set size: <num>\" on line %d.\n", line + 1);
+    return false;
+  }
+
+  if (getline(buf, buf_size, f) == -1 || sscanf(*buf, "Line size: %lu", &level->line_size) != 1) {
+    fprintf(stderr, "Expected \"Line size: <num>\" on line %d.\n", line + 2);
+    return false;
+  }
+
+  if (write_line && (getline(buf, buf_size, f) == -1 || sscanf(*buf, "Write through/no write allocate: %c", &c) != 1 || (c != 'y' && c != 'n'))) {
+    fprintf(stderr, "Expected \"Write through/no write allocate: <y,n>\" on line %d.\n", line + 3);
+    return false;
+  }
+  level->write = c == 'y';
+
+  return true;
+}
+
+// reads the "L1I: <cycles>" and "L<n>: <cycles>" lines after the fixed latency lines, up to a blank line.
+// `named` gets the deepest level named
+bool read_level_latencies(FILE* f, char** buf, size_t* buf_size, Config* config, size_t* named, int* line) {
+  while (getline(buf, buf_size, f) != -1) {
+    size_t level, latency;
+
+    *line += 1;
+    if (!strcmp(*buf, "\n")) break;
+
+    if (sscanf(*buf, "L1I: %lu", &latency) == 1) {
+      config->L1I.latency = latency;
+    } else if (sscanf(*buf, "L%lu: %lu", &level, &latency) == 2 && level >= 3 && level <= MAX_LEVELS) {
+      config->lower[level - 3].latency = latency;
+      if (level > *named) *named = level;
+    } else {
+      fprintf(stderr, "Expected \"L1I: <cycles>\" or \"L<3-%lu>: <cycles>\" on line %d.\n", MAX_LEVELS, *line);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// reads the "L<n>: <policy>" lines of the inclusion section, up to a blank line.
+// `named` gets the deepest level named
+bool read_inclusion(FILE* f, char** buf, size_t* buf_size, Config* config, size_t* named, int* line) {
+  while (getline(buf, buf_size, f) != -1) {
+    size_t level;
+    char name[16];
+    InclusionPolicy inclusion;
+
+    *line += 1;
+    if (!strcmp(*buf, "\n")) break;
+
+    if (sscanf(*buf, "L%lu: %15s", &level, name) != 2 || level < 2 || level > MAX_LEVELS || !inclusion_policy_parse(name, &inclusion)) {
+      fprintf(stderr, "Expected \"L<2-%lu>: <inclusive,nine,exclusive>\" on line %d.\n", MAX_LEVELS, *line);
+      return false;
+    }
+
+    if (level == 2)
+      config->L2_inclusion = inclusion;
+    else
+      config->lower[level - 3].inclusion = inclusion;
+    if (level > *named) *named = level;
+  }
+
+  config->report_inclusion = true;
+
+  return true;
+}
+
+// reads one "<structure>: <y,n>" line of the miss classification section
+bool read_classify(FILE* f, char** buf, size_t* buf_size, const char* structure, bool* classify, const int line) {
+  char label[8];
+  char c;
+
+  if (getline(buf, buf_size, f) == -1 || sscanf(*buf, "%7[^:]: %c", label, &c) != 2 || strcmp(label, structure) || (c != 'y' && c != 'n')) {
+    fprintf(stderr, "Expected \"%s: <y,n>\" on line %d.\n", structure, line);
+    return false;
+  }
+  *classify = c == 'y';
+
+  return true;
+}
+
+// reads one "<structure>: <cycles>" line of the latency section
+bool read_latency(FILE* f, char** buf, size_t* buf_size, const char* structure, size_t* latency, const int line) {
+  char label[16];
+
+  if (getline(buf, buf_size, f) == -1 || sscanf(*buf, "%15[^:]: %lu", label, latency) != 2 || strcmp(label, structure)) {
+    fprintf(stderr, "Expected \"%s: <cycles>\" on line %d.\n", structure, line);
+    return false;
+  }
 
   return true;
 }
@@ -161,7 +517,7 @@ Config* read_config(const char* filename) {
     return NULL;
   }
 
-  Config* config = malloc(sizeof(Config));
+  Config* config = calloc(1, sizeof(Config));
   char* buf = NULL;
   size_t buf_size;
   char c;
@@ -361,10 +717,156 @@ Config* read_config(const char* filename) {
       fprintf(stderr, "Expected \"L2: <y,n>\" on line 24.\n");
       goto config_fail;
   }
+
+  // optional sections, each one after a blank line
+  config->tlb_replacement = config->dc_replacement = config->L2_replacement = REPLACE_LRU;
+  config->pt_replacement = PAGE_LRU;
+  config->pt_type = PTABLE_FLAT;
+  config->pt_address_bits = 0;
+  config->dc_prefetch = config->L2_prefetch = PREFETCH_NONE;
+  config->dc_prefetch_degree = config->L2_prefetch_degree = 1;
+  config->dc_victim_entries = config->dc_mshr_entries = config->dc_mshr_miss_time = 0;
+  config->timing = false;
+  config->tlb_latency = config->walk_latency = config->dc_latency = 0;
+  config->L2_latency = config->memory_latency = config->disk_latency = 0;
+  config->cores = 1;
+  config->coherence = COHERENCE_MESI;
+  config->dc_classify = config->L2_classify = false;
+
+  // optional cache blocks, inclusive and untimed until the sections after them say otherwise
+  config->use_L1I = false;
+  config->num_lower = 0;
+  config->L2_inclusion = INCLUSION_INCLUSIVE;
+  config->report_inclusion = false;
+  memset(&config->L1I, 0, sizeof(config->L1I));
+  memset(config->lower, 0, sizeof(config->lower));
+  size_t named = 2;
+
+  int line = 24;
+  while (getline(&buf, &buf_size, f) != -1) {
+    line += 1;
+    if (!strcmp(buf, "\n")) continue;
+
+    char name[16];
+    size_t level;
+    if (!strcmp(buf, "Replacement policies\n")) {
+      if (!read_replacement(f, &buf, &buf_size, "TLB", &config->tlb_replacement, line + 1) ||
+          !read_replacement(f, &buf, &buf_size, "DC", &config->dc_replacement, line + 2) ||
+          !read_replacement(f, &buf, &buf_size, "L2", &config->L2_replacement, line + 3))
+        goto config_fail;
+      line += 3;
+
+      // the page table line may be left out
+      if (getline(&buf, &buf_size, f) == -1) break;
+      line += 1;
+      if (!strcmp(buf, "\n")) continue;
+
+      if (sscanf(buf, "PT: %15s", name) != 1 || !page_policy_parse(name, &config->pt_replacement)) {
+        fprintf(stderr, "Expected \"PT: <lru,clock,second-chance>\" on line %d.\n", line);
+        goto config_fail;
+      }
+    } else if (!strcmp(buf, "Page table organization\n")) {
+      getline(&buf, &buf_size, f);
+      if (sscanf(buf, "Type: %15s", name) != 1 || !page_table_type_parse(name, &config->pt_type)) {
+        fprintf(stderr, "Expected \"Type: <flat,radix,hashed>\" on line %d.\n", line + 1);
+        goto config_fail;
+      }
+
+      getline(&buf, &buf_size, f);
+      if (sscanf(buf, "Virtual address bits: %lu", &config->pt_address_bits) != 1) {
+        fprintf(stderr, "Expected \"Virtual address bits: <int>\" on line %d.\n", line + 2);
+        goto config_fail;
+      }
+      line += 2;
+    } else if (!strcmp(buf, "Prefetchers\n")) {
+      if (!read_prefetcher(f, &buf, &buf_size, "DC", &config->dc_prefetch, &config->dc_prefetch_degree, line + 1) ||
+          !read_prefetcher(f, &buf, &buf_size, "L2", &config->L2_prefetch, &config->L2_prefetch_degree, line + 2))
+        goto config_fail;
+      line += 2;
+    } else if (!strcmp(buf, "Victim cache and MSHRs\n")) {
+      getline(&buf, &buf_size, f);
+      if (sscanf(buf, "Victim entries: %lu", &config->dc_victim_entries) != 1) {
+        fprintf(stderr, "Expected \"Victim entries: <int>\" on line %d.\n", line + 1);
+        goto config_fail;
+      }
+
+      getline(&buf, &buf_size, f);
+      if (sscanf(buf, "MSHR entries: %lu", &config->dc_mshr_entries) != 1) {
+        fprintf(stderr, "Expected \"MSHR entries: <int>\" on line %d.\n", line + 2);
+        goto config_fail;
+      }
+
+      getline(&buf, &buf_size, f);
+      if (sscanf(buf, "MSHR miss time: %lu", &config->dc_mshr_miss_time) != 1) {
+        fprintf(stderr, "Expected \"MSHR miss time: <int>\" on line %d.\n", line + 3);
+        goto config_fail;
+      }
+      line += 3;
+    } else if (!strcmp(buf, "Latencies\n")) {
+      if (!read_latency(f, &buf, &buf_size, "TLB", &config->tlb_latency, line + 1) ||
+          !read_latency(f, &buf, &buf_size, "Page walk", &config->walk_latency, line + 2) ||
+          !read_latency(f, &buf, &buf_size, "DC", &config->dc_latency, line + 3) ||
+          !read_latency(f, &buf, &buf_size, "L2", &config->L2_latency, line + 4) ||
+          !read_latency(f, &buf, &buf_size, "Memory", &config->memory_latency, line + 5) ||
+          !read_latency(f, &buf, &buf_size, "Disk", &config->disk_latency, line + 6))
+        goto config_fail;
+      config->timing = true;
+      line += 6;
+
+      if (!read_level_latencies(f, &buf, &buf_size, config, &named, &line))
+        goto config_fail;
+    } else if (!strcmp(buf, "Instruction Cache configuration\n")) {
+      if (!read_cache_block(f, &buf, &buf_size, &config->L1I, false, line + 1))
+        goto config_fail;
+      config->use_L1I = true;
+      line += 3;
+    } else if (sscanf(buf, "L%lu Cache configuration", &level) == 1) {
+      if (level != config->num_lower + 3 || level > MAX_LEVELS) {
+        fprintf(stderr, "Expected \"L%lu Cache configuration\" on line %d, levels go in order up to L%lu.\n", config->num_lower + 3, line, MAX_LEVELS);
+        goto config_fail;
+      }
+
+      if (!read_cache_block(f, &buf, &buf_size, config->lower + config->num_lower, true, line + 1))
+        goto config_fail;
+      config->num_lower += 1;
+      line += 4;
+    } else if (!strcmp(buf, "Inclusion policies\n")) {
+      if (!read_inclusion(f, &buf, &buf_size, config, &named, &line))
+        goto config_fail;
+    } else if (!strcmp(buf, "Multi-core\n")) {
+      getline(&buf, &buf_size, f);
+      if (sscanf(buf, "Cores: %lu", &config->cores) != 1) {
+        fprintf(stderr, "Expected \"Cores: <int>\" on line %d.\n", line + 1);
+        goto config_fail;
+      }
+
+      getline(&buf, &buf_size, f);
+      if (sscanf(buf, "Protocol: %15s", name) != 1 || !coherence_protocol_parse(name, &config->coherence) || config->coherence == COHERENCE_NONE) {
+        fprintf(stderr, "Expected \"Protocol: <mesi,moesi>\" on line %d.\n", line + 2);
+        goto config_fail;
+      }
+      line += 2;
+    } else if (!strcmp(buf, "Miss classification\n")) {
+      if (!read_classify(f, &buf, &buf_size, "DC", &config->dc_classify, line + 1) ||
+          !read_classify(f, &buf, &buf_size, "L2", &config->L2_classify, line + 2))
+        goto config_fail;
+      line += 2;
+    } else {
+      fprintf(stderr, "Expected \"Replacement policies\", \"Page table organization\", \"Prefetchers\", \"Victim cache and MSHRs\", \"Latencies\", \"Multi-core\",\n"
+                      "\"Instruction Cache configuration\", \"L<n> Cache configuration\", \"Inclusion policies\" or \"Miss classification\" on line %d.\n", line);
+      goto config_fail;
+    }
+  }
   
   fclose(f);
   free(buf);
 
+  // latencies and inclusion policies can only name configured levels
+  if (named > config->num_lower + 2) {
+    fprintf(stderr, "L%lu is named but only levels up to L%lu are configured.\n", named, config->num_lower + 2);
+    goto config_fail;
+  }
+
   // CONSTRAINT VALIDATION
   if (!validate_config(config)) goto config_fail;
 
@@ -0,0 +1,1062 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hierarchy.h"
+#include "snapshot.h"
+#include "util.h"
+
+#define STAT_LABEL_SIZE 32
+
+struct RefStats {
+  size_t memory_refs;
+  size_t pt_refs;
+  size_t disk_refs;
+};
+
+typedef struct RefStats RefStats;
+
+// the cache in front of main memory
+static Cache* _hierarchy_last_level(const Hierarchy* hierarchy) {
+  if (hierarchy->num_lower) return hierarchy->lower[hierarchy->num_lower - 1];
+  return hierarchy->L2 ? hierarchy->L2 : hierarchy->dcs[0];
+}
+
+// every cache of the hierarchy from the top down, returns how many were stored in `caches`
+static size_t _hierarchy_caches(const Hierarchy* hierarchy, Cache** caches) {
+  size_t count = 0;
+
+  for (size_t i = 0; i < hierarchy->cores; i++) {
+    if (hierarchy->dcs[i]) caches[count++] = hierarchy->dcs[i];
+    if (hierarchy->L1Is[i]) caches[count++] = hierarchy->L1Is[i];
+  }
+  if (hierarchy->L2) caches[count++] = hierarchy->L2;
+  for (size_t i = 0; i < hierarchy->num_lower; i++)
+    caches[count++] = hierarchy->lower[i];
+
+  return count;
+}
+
+Hierarchy* hierarchy_new(const Config* config) {
+  Hierarchy* hierarchy = calloc(1, sizeof(Hierarchy));
+  hierarchy->config = config;
+
+  // PAGE TABLE
+  PTable* ptable = config->virtual_addresses ? ptable_new(config->pt_num_vpages, config->pt_num_ppages, config->pt_page_size, config->pt_type, config->pt_address_bits, config->pt_replacement) : NULL;
+
+  // TLB
+  TLB* tlb = config->use_tlb ? TLB_new(ptable, config->tlb_num_sets, config->tlb_set_size, config->pt_page_size, config->tlb_replacement) : NULL;
+  
+  if (ptable && tlb)
+    ptable_connect_tlb(ptable, tlb); 
+
+  hierarchy->ptable = ptable;
+  hierarchy->tlb = tlb;
+  hierarchy->cores = config->cores;
+
+  // DC CACHES, one per core (with an L1I beside each one)
+  for (size_t i = 0; i < hierarchy->cores; i++) {
+    Cache* dc = cache_new(config->dc_num_sets, config->dc_set_size, config->dc_line_size, config->dc_write ? WRITE_THROUGH : WRITE_BACK, config->dc_write ? NO_WRALLOC : WRALLOC, config->dc_replacement);
+    if (!dc) {
+      fprintf(stderr, "Failed to initialize dc\n");
+      hierarchy_free(hierarchy);
+      return NULL;
+    }
+    hierarchy->dcs[i] = dc;
+
+    if (hierarchy->cores > 1) {
+      snprintf(cache_stats(dc)->name, sizeof(cache_stats(dc)->name), "dc%lu", i);
+      cache_set_coherence(dc, config->coherence);
+    } else {
+      strcpy(cache_stats(dc)->name, "dc");
+    }
+    cache_set_prefetcher(dc, config->dc_prefetch, config->dc_prefetch_degree);
+    cache_set_victim(dc, config->dc_victim_entries);
+    cache_set_mshrs(dc, config->dc_mshr_entries, config->dc_mshr_miss_time);
+    cache_set_classify(dc, config->dc_classify);
+
+    if (!config->use_L1I) continue;
+
+    // instructions are only read, so the write policy doesn't matter
+    Cache* L1I = cache_new(config->L1I.num_sets, config->L1I.set_size, config->L1I.line_size, WRITE_BACK, WRALLOC, REPLACE_LRU);
+    if (!L1I) {
+      fprintf(stderr, "Failed to initialize L1I\n");
+      hierarchy_free(hierarchy);
+      return NULL;
+    }
+    hierarchy->L1Is[i] = L1I;
+
+    if (hierarchy->cores > 1)
+      snprintf(cache_stats(L1I)->name, sizeof(cache_stats(L1I)->name), "L1I%lu", i);
+    else
+      strcpy(cache_stats(L1I)->name, "L1I");
+  }
+  
+  // L2 CACHE
+  Cache* L2 = NULL;
+  if (config->use_L2) {
+    L2 = cache_new(config->L2_num_sets, config->L2_set_size, config->L2_line_size, config->L2_write ? WRITE_THROUGH : WRITE_BACK, config->L2_write ? NO_WRALLOC : WRALLOC, config->L2_replacement);
+    if (!L2) {
+      fprintf(stderr, "Failed to initialize L2\n");
+      hierarchy_free(hierarchy);
+      return NULL;
+    }
+    hierarchy->L2 = L2;
+    strcpy(cache_stats(L2)->name, "L2");
+    cache_set_prefetcher(L2, config->L2_prefetch, config->L2_prefetch_degree);
+    cache_set_inclusion(L2, config->L2_inclusion);
+    cache_set_classify(L2, config->L2_classify);
+
+    // CONNECT CACHES
+    for (size_t i = 0; i < hierarchy->cores; i++) {
+      cache_connect(hierarchy->dcs[i], L2);
+      if (hierarchy->L1Is[i]) cache_connect(hierarchy->L1Is[i], L2);
+    }
+  }
+
+  // LOWER LEVELS, each one below the last
+  for (size_t i = 0; i < config->num_lower; i++) {
+    const LevelConfig* level = config->lower + i;
+    Cache* cache = cache_new(level->num_sets, level->set_size, level->line_size, level->write ? WRITE_THROUGH : WRITE_BACK, level->write ? NO_WRALLOC : WRALLOC, REPLACE_LRU);
+    if (!cache) {
+      fprintf(stderr, "Failed to initialize L%lu\n", i + 3);
+      hierarchy_free(hierarchy);
+      return NULL;
+    }
+    snprintf(cache_stats(cache)->name, sizeof(cache_stats(cache)->name), "L%lu", i + 3);
+    cache_set_inclusion(cache, level->inclusion);
+
+    cache_connect(i ? hierarchy->lower[i - 1] : L2, cache);
+    hierarchy->lower[i] = cache;
+    hierarchy->num_lower += 1;
+  }
+
+  // evicted pages are invalidated from the last level up
+  if (ptable) ptable_connect_cache(ptable, _hierarchy_last_level(hierarchy));
+
+  if (config->timing) {
+    if (tlb) TLB_set_timing(tlb, &hierarchy->cycles, config->tlb_latency);
+    if (ptable) ptable_set_timing(ptable, &hierarchy->cycles, config->walk_latency, config->disk_latency);
+    for (size_t i = 0; i < hierarchy->cores; i++) {
+      cache_set_timing(hierarchy->dcs[i], &hierarchy->cycles, config->dc_latency, config->memory_latency);
+      if (hierarchy->L1Is[i]) cache_set_timing(hierarchy->L1Is[i], &hierarchy->cycles, config->L1I.latency, config->memory_latency);
+    }
+    if (L2) cache_set_timing(L2, &hierarchy->cycles, config->L2_latency, config->memory_latency);
+    for (size_t i = 0; i < hierarchy->num_lower; i++)
+      cache_set_timing(hierarchy->lower[i], &hierarchy->cycles, config->lower[i].latency, config->memory_latency);
+  }
+  // the last valid address. radix and hashed tables cover their whole virtual address width,
+  // physical addresses have to fit the 32 bit caches.
+  if (config->virtual_addresses && config->pt_type != PTABLE_FLAT)
+    hierarchy->max_address = config->pt_address_bits < 64 ? (1ull << config->pt_address_bits) - 1 : UINT64_MAX;
+  else
+    hierarchy->max_address = (uint64_t) config->pt_page_size * (config->virtual_addresses ? config->pt_num_vpages : config->pt_num_ppages) - 1;
+
+  if (!config->virtual_addresses && hierarchy->max_address > UINT32_MAX)
+    hierarchy->max_address = UINT32_MAX;
+
+  return hierarchy;
+}
+
+void hierarchy_free(Hierarchy* hierarchy) {
+  Cache* caches[HIERARCHY_MAX_CACHES];
+  size_t count = _hierarchy_caches(hierarchy, caches);
+
+  for (size_t i = 0; i < count; i++)
+    cache_free(caches[i]);
+  if (hierarchy->tlb) TLB_free(hierarchy->tlb);
+  if (hierarchy->ptable) ptable_free(hierarchy->ptable);
+  free(hierarchy);
+}
+
+// Restricts every cache to the sets whose low last level index bits (the lowest level, or dc without an L2)
+// equal `part`, out of 1 << `bits` parts. Lines only grow going down, so those bits have to fall inside
+// the index of every level above too. Then every selected set of any cache sees all of its references
+// and inclusion still holds.
+static bool _hierarchy_select_sets(Hierarchy* hierarchy, const size_t bits, const uint32_t part) {
+  Cache* caches[HIERARCHY_MAX_CACHES];
+  size_t count = _hierarchy_caches(hierarchy, caches);
+  const Config* config = hierarchy->config;
+  size_t line_size = config->num_lower ? config->lower[config->num_lower - 1].line_size : hierarchy->L2 ? config->L2_line_size : config->dc_line_size;
+  size_t pos = log_2(line_size);
+
+  uint32_t mask = ~(~0u << bits) << pos;
+  uint32_t value = part << pos;
+  bool sampled = true;
+  for (size_t i = 0; i < count; i++)
+    sampled = sampled && cache_sample(caches[i], mask, value);
+
+  if (!sampled) {
+    fprintf(stderr, "Can't split the caches %lu ways: the selected bits have to be part of the index of every cache.\n", 1lu << bits);
+    return false;
+  }
+
+  hierarchy->sample_mask = mask;
+  hierarchy->sample_value = value;
+  return true;
+}
+
+// samples every `ratio`th set
+bool hierarchy_sample(Hierarchy* hierarchy, const size_t ratio) {
+  if (!_hierarchy_select_sets(hierarchy, log_2(ratio), 0)) return false;
+
+  hierarchy->sample_ratio = ratio;
+  return true;
+}
+
+bool hierarchy_partition(Hierarchy* hierarchy, const size_t parts, const size_t part) {
+  if (hierarchy->ptable) {
+    fprintf(stderr, "Only physical address traces can be split by set.\n");
+    return false;
+  }
+  // next lines belong to other partitions, victim caches and MSHRs are shared by every set
+  if (hierarchy->config->dc_prefetch != PREFETCH_NONE || hierarchy->config->L2_prefetch != PREFETCH_NONE ||
+      hierarchy->config->dc_victim_entries || hierarchy->config->dc_mshr_entries) {
+    fprintf(stderr, "Runs with prefetchers, a victim cache or MSHRs can't be split by set.\n");
+    return false;
+  }
+  // the shadow cache of a partition would only compete with the lines of its own sets
+  if (hierarchy->config->dc_classify || hierarchy->config->L2_classify) {
+    fprintf(stderr, "Runs classifying misses can't be split by set.\n");
+    return false;
+  }
+
+  return _hierarchy_select_sets(hierarchy, log_2(parts), part);
+}
+
+// adds the counters of `from` (another partition of the same configuration) into `into`
+void hierarchy_merge(Hierarchy* into, const Hierarchy* from) {
+  Cache* caches[2][HIERARCHY_MAX_CACHES];
+  size_t count = _hierarchy_caches(into, caches[0]);
+  _hierarchy_caches(from, caches[1]);
+
+  for (size_t i = 0; i < count; i++) {
+    CacheStats* a = cache_stats(caches[0][i]);
+    const CacheStats* b = cache_stats(caches[1][i]);
+
+    a->hits += b->hits;
+    a->reads += b->reads;
+    a->mem_accesses += b->mem_accesses;
+    a->total_accesses += b->total_accesses;
+    a->back_invalidations += b->back_invalidations;
+    a->victim_fills += b->victim_fills;
+
+    CoherenceStats* ca = cache_coherence_stats(caches[0][i]);
+    const CoherenceStats* cb = cache_coherence_stats(caches[1][i]);
+    if (ca) {
+      ca->coherence_misses += cb->coherence_misses;
+      ca->invalidations += cb->invalidations;
+      ca->upgrades += cb->upgrades;
+      ca->transfers += cb->transfers;
+    }
+
+    MissStats* ma = cache_miss_stats(caches[0][i]);
+    const MissStats* mb = cache_miss_stats(caches[1][i]);
+    if (ma) {
+      ma->compulsory += mb->compulsory;
+      ma->capacity += mb->capacity;
+      ma->conflict += mb->conflict;
+    }
+
+    PrefetchStats* pa = cache_prefetch_stats(caches[0][i]);
+    const PrefetchStats* pb = cache_prefetch_stats(caches[1][i]);
+    if (!pa) continue;
+
+    pa->issued += pb->issued;
+    pa->useful += pb->useful;
+    pa->unused += pb->unused;
+    pa->late += pb->late;
+    pa->lead += pb->lead;
+    pa->pollution += pb->pollution;
+    pa->misses += pb->misses;
+  }
+
+  into->fetches += from->fetches;
+  for (size_t type = 0; type < 3; type++) {
+    into->total_cycles[type] += from->total_cycles[type];
+    into->timed[type] += from->timed[type];
+    for (size_t i = 0; i < HIERARCHY_LATENCY_BUCKETS; i++)
+      into->latency_histogram[type][i] += from->latency_histogram[type][i];
+  }
+}
+
+// the hierarchy's own counters, saves and loads go through the same list. `io` either writes or reads each one
+static bool _hierarchy_snapshot(Hierarchy* hierarchy, FILE* f, bool (*io)(FILE*, void*, size_t)) {
+  return io(f, &hierarchy->rejected, sizeof(hierarchy->rejected))
+    && io(f, &hierarchy->skipped, sizeof(hierarchy->skipped))
+    && io(f, &hierarchy->fetches, sizeof(hierarchy->fetches))
+    && io(f, &hierarchy->references, sizeof(hierarchy->references))
+    && io(f, hierarchy->total_cycles, sizeof(hierarchy->total_cycles))
+    && io(f, hierarchy->timed, sizeof(hierarchy->timed))
+    && io(f, hierarchy->latency_histogram, sizeof(hierarchy->latency_histogram));
+}
+
+static bool _hierarchy_write(FILE* f, void* data, size_t size) {
+  return snapshot_write(f, data, size);
+}
+
+static bool _hierarchy_read(FILE* f, void* data, size_t size) {
+  return snapshot_read(f, data, size);
+}
+
+bool hierarchy_save(const Hierarchy* hierarchy, const char* filename) {
+  FILE* f = fopen(filename, "wb");
+  if (!f) {
+    perror("Failed to open snapshot file");
+    return false;
+  }
+
+  SnapshotHeader header;
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = SNAPSHOT_VERSION;
+  header.config_size = sizeof(Config);
+
+  Cache* caches[HIERARCHY_MAX_CACHES];
+  size_t count = _hierarchy_caches(hierarchy, caches);
+
+  bool ok = snapshot_write(f, &header, sizeof(header))
+    && snapshot_write(f, hierarchy->config, sizeof(Config))
+    && snapshot_write(f, &hierarchy->sample_mask, sizeof(hierarchy->sample_mask))
+    && snapshot_write(f, &hierarchy->sample_value, sizeof(hierarchy->sample_value))
+    && snapshot_write(f, &hierarchy->instrumented, sizeof(hierarchy->instrumented))
+    && _hierarchy_snapshot((Hierarchy*) hierarchy, f, _hierarchy_write)
+    && (!hierarchy->ptable || ptable_save(hierarchy->ptable, f))
+    && (!hierarchy->tlb || TLB_save(hierarchy->tlb, f));
+  for (size_t i = 0; ok && i < count; i++)
+    ok = cache_save(caches[i], f);
+
+  if (fclose(f) || !ok) {
+    perror("Failed to write snapshot file");
+    return false;
+  }
+
+  return true;
+}
+
+bool hierarchy_load(Hierarchy* hierarchy, const char* filename) {
+  FILE* f = fopen(filename, "rb");
+  if (!f) {
+    perror("Failed to open snapshot file");
+    return false;
+  }
+
+  SnapshotHeader header;
+  Config config;
+  uint32_t sample_mask, sample_value;
+  uint8_t instrumented;    // any other byte than 0 or 1 isn't a bool
+
+  if (!snapshot_read(f, &header, sizeof(header)) || memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic))
+      || header.version != SNAPSHOT_VERSION || header.config_size != sizeof(Config)) {
+    fprintf(stderr, "Snapshot file is not a version %u snapshot of this build.\n", SNAPSHOT_VERSION);
+    fclose(f);
+    return false;
+  }
+
+  if (!snapshot_read(f, &config, sizeof(Config)) || memcmp(&config, hierarchy->config, sizeof(Config))) {
+    fprintf(stderr, "Snapshot was taken with a different configuration.\n");
+    fclose(f);
+    return false;
+  }
+
+  if (!snapshot_read(f, &sample_mask, sizeof(sample_mask)) || !snapshot_read(f, &sample_value, sizeof(sample_value))
+      || sample_mask != hierarchy->sample_mask || sample_value != hierarchy->sample_value) {
+    fprintf(stderr, "Snapshot was taken with different set sampling.\n");
+    fclose(f);
+    return false;
+  }
+
+  if (!snapshot_read(f, &instrumented, sizeof(instrumented)) || instrumented != hierarchy->instrumented) {
+    fprintf(stderr, "Snapshot was taken %s instrumentation.\n", hierarchy->instrumented ? "without" : "with");
+    fclose(f);
+    return false;
+  }
+
+  Cache* caches[HIERARCHY_MAX_CACHES];
+  size_t count = _hierarchy_caches(hierarchy, caches);
+
+  bool ok = _hierarchy_snapshot(hierarchy, f, _hierarchy_read)
+    && (!hierarchy->ptable || ptable_load(hierarchy->ptable, f))
+    && (!hierarchy->tlb || TLB_load(hierarchy->tlb, f));
+  for (size_t i = 0; ok && i < count; i++)
+    ok = cache_load(caches[i], f);
+
+  // nothing may be left over either
+  ok = ok && fgetc(f) == EOF;
+  fclose(f);
+
+  if (!ok)
+    fprintf(stderr, "Snapshot file is truncated or corrupt.\n");
+  return ok;
+}
+
+void hierarchy_instrument(Hierarchy* hierarchy) {
+  Cache* caches[HIERARCHY_MAX_CACHES];
+  size_t count = _hierarchy_caches(hierarchy, caches);
+
+  for (size_t i = 0; i < count; i++)
+    cache_set_instrument(caches[i], true);
+  if (hierarchy->ptable) ptable_set_instrument(hierarchy->ptable, true);
+  hierarchy->instrumented = true;
+}
+
+void hierarchy_warmup(Hierarchy* hierarchy, const size_t references) {
+  hierarchy->warmup = references ? hierarchy->references + references : 0;
+}
+
+void hierarchy_reset_stats(Hierarchy* hierarchy) {
+  Cache* caches[HIERARCHY_MAX_CACHES];
+  size_t count = _hierarchy_caches(hierarchy, caches);
+
+  for (size_t i = 0; i < count; i++)
+    cache_reset_stats(caches[i]);
+  if (hierarchy->tlb) TLB_reset_stats(hierarchy->tlb);
+  if (hierarchy->ptable) ptable_reset_stats(hierarchy->ptable);
+
+  hierarchy->rejected = 0;
+  hierarchy->skipped = 0;
+  hierarchy->fetches = 0;
+  memset(hierarchy->total_cycles, 0, sizeof(hierarchy->total_cycles));
+  memset(hierarchy->timed, 0, sizeof(hierarchy->timed));
+  memset(hierarchy->latency_histogram, 0, sizeof(hierarchy->latency_histogram));
+}
+
+Cache* hierarchy_l1(const Hierarchy* hierarchy, const uint32_t core, const TraceAccess access) {
+  if (access == TRACE_FETCH && hierarchy->L1Is[core]) return hierarchy->L1Is[core];
+  return hierarchy->dcs[core];
+}
+
+static HierarchyResult _hierarchy_access(Hierarchy* hierarchy, const uint32_t core, const TraceAccess access, const uint64_t address, uint32_t* paddress) {
+  const bool write = access == TRACE_WRITE;
+
+  // check if the address is too large
+  if (address > hierarchy->max_address) {
+    hierarchy->rejected += 1;
+    return HIERARCHY_REJECTED;
+  }
+
+  if (core >= hierarchy->cores) {
+    hierarchy->rejected += 1;
+    return HIERARCHY_BAD_CORE;
+  }
+
+  hierarchy->cycles = 0;
+
+  // ADDRESS TRANSLATION
+  if (hierarchy->tlb)
+    *paddress = TLB_virt_phys(hierarchy->tlb, address, write);
+  else if (hierarchy->ptable)
+    *paddress = ptable_virt_phys(hierarchy->ptable, address, write);
+  else
+    *paddress = (uint32_t) address;
+
+  // SET SAMPLING
+  if ((*paddress & hierarchy->sample_mask) != hierarchy->sample_value) {
+    hierarchy->skipped += 1;
+    return HIERARCHY_SKIPPED;
+  }
+
+  Cache* l1 = hierarchy_l1(hierarchy, core, access);
+  if (access == TRACE_FETCH)
+    hierarchy->fetches += 1;
+
+  // reset inserts
+  cache_stats(l1)->hit = false;
+  if (hierarchy->L2)
+    cache_stats(hierarchy->L2)->hit = false;
+  
+  // CACHE ACCESS
+  if (write)
+    cache_write(l1, *paddress, true);
+  else
+    cache_read(l1, *paddress);
+
+  if (hierarchy->config->timing) {
+    hierarchy->total_cycles[access] += hierarchy->cycles;
+    hierarchy->timed[access] += 1;
+    hierarchy->latency_histogram[access][hierarchy->cycles ? 64 - __builtin_clzll(hierarchy->cycles) : 0] += 1;
+  }
+
+  return HIERARCHY_OK;
+}
+
+HierarchyResult hierarchy_access(Hierarchy* hierarchy, const uint32_t core, const TraceAccess access, const uint64_t address, uint32_t* paddress) {
+  HierarchyResult result = _hierarchy_access(hierarchy, core, access, address, paddress);
+
+  // the warm-up references only fill the hierarchy, what they counted is thrown away
+  if (++hierarchy->references == hierarchy->warmup)
+    hierarchy_reset_stats(hierarchy);
+
+  return result;
+}
+
+void hierarchy_skip(Hierarchy* hierarchy, size_t references) {
+  // the warm-up ends among them, only the ones after it are counted
+  if (hierarchy->warmup > hierarchy->references && hierarchy->warmup <= hierarchy->references + references) {
+    references -= hierarchy->warmup - hierarchy->references;
+    hierarchy->references = hierarchy->warmup;
+    hierarchy_reset_stats(hierarchy);
+  }
+
+  hierarchy->references += references;
+  hierarchy->skipped += references;
+}
+
+static void _hierarchy_ref_stats(const Hierarchy* hierarchy, RefStats* ref_stats) {
+  const PTableStats* pt_stats = hierarchy->ptable ? ptable_stats(hierarchy->ptable) : NULL;
+
+  ref_stats->memory_refs = cache_stats(_hierarchy_last_level(hierarchy))->mem_accesses;
+  ref_stats->pt_refs = pt_stats ? pt_stats->total_accesses : 0;
+  ref_stats->disk_refs = pt_stats ? pt_stats->disk_accesses : 0;
+}
+
+// adds up the hits and accesses of every core's dc (or L1I), zero without them
+static void _hierarchy_totals(Cache* const* caches, const size_t cores, CacheStats* totals) {
+  memset(totals, 0, sizeof(CacheStats));
+
+  for (size_t i = 0; i < cores && caches[i]; i++) {
+    const CacheStats* stats = cache_stats(caches[i]);
+    totals->hits += stats->hits;
+    totals->reads += stats->reads;
+    totals->mem_accesses += stats->mem_accesses;
+    totals->total_accesses += stats->total_accesses;
+  }
+}
+
+// adds up the 3C counters of every core's dc, zero when they don't classify
+static void _hierarchy_miss_totals(Cache* const* caches, const size_t cores, MissStats* totals) {
+  memset(totals, 0, sizeof(MissStats));
+
+  for (size_t i = 0; i < cores && caches[i]; i++) {
+    const MissStats* stats = cache_miss_stats(caches[i]);
+    if (!stats) continue;
+
+    totals->compulsory += stats->compulsory;
+    totals->capacity += stats->capacity;
+    totals->conflict += stats->conflict;
+  }
+}
+
+// fetches read the dc when there's no L1I, they aren't data reads
+static size_t _hierarchy_data_reads(const Hierarchy* hierarchy, const CacheStats* dc_stats) {
+  return dc_stats->reads - (hierarchy->L1Is[0] ? 0 : hierarchy->fetches);
+}
+
+// "<name> <field>" for the per cache lines, so names like dc0 or L1I1 keep the colons lined up
+static const char* _hierarchy_label(char* label, const char* name, const char* field) {
+  snprintf(label, STAT_LABEL_SIZE, "%s %s", name, field);
+  return label;
+}
+
+static void print_cache_stats(const CacheStats* stats, const char* name) {
+  char label[STAT_LABEL_SIZE];
+
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "hits"), stats ? stats->hits : 0);
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "misses"), stats ? (stats->total_accesses - stats->hits) : 0);
+
+  if (stats && stats->total_accesses)
+    printf("%-17s: %lf\n", _hierarchy_label(label, name, "hit ratio"), (double) stats->hits / (double) stats->total_accesses);
+  else
+    printf("%-17s: %s\n", _hierarchy_label(label, name, "hit ratio"), "N/A");
+}
+
+static void print_prefetch_stats(const PrefetchStats* stats, const char* name) {
+  char label[STAT_LABEL_SIZE];
+
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "pf issued"), stats->issued);
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "pf useful"), stats->useful);
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "pf unused"), stats->unused);
+
+  if (stats->issued)
+    printf("%-17s: %lf\n", _hierarchy_label(label, name, "pf accuracy"), (double) stats->useful / (double) stats->issued);
+  else
+    printf("%-17s: %s\n", _hierarchy_label(label, name, "pf accuracy"), "N/A");
+
+  if (stats->useful + stats->misses)
+    printf("%-17s: %lf\n", _hierarchy_label(label, name, "pf coverage"), (double) stats->useful / (double)(stats->useful + stats->misses));
+  else
+    printf("%-17s: %s\n", _hierarchy_label(label, name, "pf coverage"), "N/A");
+
+  if (stats->useful)
+    printf("%-17s: %lf\n", _hierarchy_label(label, name, "pf avg lead"), (double) stats->lead / (double) stats->useful);
+  else
+    printf("%-17s: %s\n", _hierarchy_label(label, name, "pf avg lead"), "N/A");
+
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "pf late"), stats->late);
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "pf pollution"), stats->pollution);
+}
+
+static void print_victim_stats(const VictimStats* stats, const char* name) {
+  char label[STAT_LABEL_SIZE];
+
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "vc probes"), stats->probes);
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "vc hits"), stats->hits);
+
+  if (stats->probes)
+    printf("%-17s: %lf\n", _hierarchy_label(label, name, "vc hit ratio"), (double) stats->hits / (double) stats->probes);
+  else
+    printf("%-17s: %s\n", _hierarchy_label(label, name, "vc hit ratio"), "N/A");
+
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "vc writebacks"), stats->writebacks);
+}
+
+static void print_mshr_stats(const MSHRStats* stats, const char* name) {
+  char label[STAT_LABEL_SIZE];
+
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "mshr primary"), stats->primary);
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "mshr merged"), stats->merged);
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "mshr stalls"), stats->stalls);
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "mshr peak"), stats->peak);
+}
+
+static void print_coherence_stats(const CoherenceStats* stats, const char* name) {
+  char label[STAT_LABEL_SIZE];
+
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "coh misses"), stats->coherence_misses);
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "invalidations"), stats->invalidations);
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "upgrades"), stats->upgrades);
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "transfers"), stats->transfers);
+}
+
+static void print_inclusion_stats(const CacheStats* stats, const char* name) {
+  char label[STAT_LABEL_SIZE];
+
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "back-invals"), stats->back_invalidations);
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "victim fills"), stats->victim_fills);
+}
+
+static void print_miss_stats(const MissStats* stats, const char* name) {
+  char label[STAT_LABEL_SIZE];
+
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "compulsory"), stats->compulsory);
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "capacity"), stats->capacity);
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "conflict"), stats->conflict);
+}
+
+static void print_rw_stats(const size_t reads, const size_t writes, const size_t fetches) {
+  printf("%-17s: %lu\n", "Total reads", reads);
+  printf("%-17s: %lu\n", "Total writes", writes);
+  printf("%-17s: %lf\n", "Ratio of reads", (double) reads / (double)(reads + writes));
+  if (fetches)
+    printf("%-17s: %lu\n", "Total fetches", fetches);
+}
+
+static void print_pt_stats(const PTableStats* ptable, const bool show_size) {
+  printf("%-17s: %lu\n", "pt hits", ptable ? ptable->hits : 0);
+  printf("%-17s: %lu\n", "pt faults", ptable ? (ptable->total_accesses - ptable->hits) : 0);
+  if (ptable)
+    printf("%-17s: %lf\n", "pt hit ratio", (double) ptable->hits / (double) ptable->total_accesses); 
+  else
+    printf("%-17s: %s\n", "pt hit ratio", "N/A");
+
+  if (ptable && show_size)
+    printf("%-17s: %lu\n", "pt table bytes", ptable->table_bytes);
+}
+
+static void print_ref_stats(const RefStats* ref_stats) {
+  printf("%-17s: %lu\n", "main memory refs", ref_stats->memory_refs); 
+  printf("%-17s: %lu\n", "page table refs", ref_stats->pt_refs);
+  printf("%-17s: %lu\n", "disk refs", ref_stats->disk_refs);
+}
+
+static void print_tlb_stats(const TLBStats* tlb_stats, const bool verbose) {
+
+  printf("%-17s: %lu\n", "dtlb hits", tlb_stats ? tlb_stats->hits : 0);
+  printf("%-17s: %lu\n", "dtlb misses", tlb_stats ? (tlb_stats->total_accesses - tlb_stats->hits) : 0);
+  
+  if (tlb_stats)
+    printf("%-17s: %lf\n", "dtlb hit ratio", (double) tlb_stats->hits / (double) tlb_stats->total_accesses);
+  else
+    printf("%-17s: %s\n", "dtlb hit ratio" , "N/A");
+
+  if (tlb_stats && verbose)
+    printf("%-17s: %lu\n", "dtlb shootdowns", tlb_stats->shootdowns);
+}
+
+static void print_sample_cache(const Cache* cache, const char* name, const size_t ratio) {
+  const CacheStats* stats = cache_stats(cache);
+  double half_width;
+  double miss_ratio = cache_sample_miss_ratio(cache, &half_width);
+  char label[STAT_LABEL_SIZE];
+
+  printf("%-17s: %lu\n", _hierarchy_label(label, name, "est. misses"), (stats->total_accesses - stats->hits) * ratio);
+  if (isnan(half_width))
+    printf("%-17s: %lf\n", _hierarchy_label(label, name, "est. miss rate"), miss_ratio);
+  else
+    printf("%-17s: %lf +/- %lf (95%%)\n", _hierarchy_label(label, name, "est. miss rate"), miss_ratio, half_width);
+}
+
+static void print_latency_histogram(const size_t* histogram, const char* type) {
+  printf("\n%s latency (cycles)\n", type);
+
+  for (size_t i = 0; i < HIERARCHY_LATENCY_BUCKETS; i++) {
+    if (!histogram[i]) continue;
+
+    // bucket i holds [2^(i-1), 2^i - 1]
+    char range[48];
+    uint64_t low = i ? 1ull << (i - 1) : 0;
+    uint64_t high = i ? low * 2 - 1 : 0;
+    if (low == high)
+      snprintf(range, sizeof(range), "  %lu", low);
+    else
+      snprintf(range, sizeof(range), "  %lu-%lu", low, high);
+    printf("%-17s: %lu\n", range, histogram[i]);
+  }
+}
+
+static void print_timing_stats(const Hierarchy* hierarchy) {
+  uint64_t cycles = hierarchy->total_cycles[TRACE_READ] + hierarchy->total_cycles[TRACE_WRITE] + hierarchy->total_cycles[TRACE_FETCH];
+  size_t timed = hierarchy->timed[TRACE_READ] + hierarchy->timed[TRACE_WRITE] + hierarchy->timed[TRACE_FETCH];
+  static const char* types[] = { [TRACE_READ] = "read", [TRACE_WRITE] = "write", [TRACE_FETCH] = "fetch" };
+  static const char* labels[] = { [TRACE_READ] = "read AMAT", [TRACE_WRITE] = "write AMAT", [TRACE_FETCH] = "fetch AMAT" };
+
+  printf("\nTiming\n\n");
+  printf("%-17s: %lu\n", "total cycles", cycles);
+  if (timed)
+    printf("%-17s: %lf\n", "AMAT", (double) cycles / (double) timed);
+  else
+    printf("%-17s: %s\n", "AMAT", "N/A");
+
+  // fetches only get a line when there were any
+  for (size_t type = 0; type < 3; type++) {
+    if (hierarchy->timed[type])
+      printf("%-17s: %lf\n", labels[type], (double) hierarchy->total_cycles[type] / (double) hierarchy->timed[type]);
+    else if (type != TRACE_FETCH)
+      printf("%-17s: %s\n", labels[type], "N/A");
+  }
+
+  for (size_t type = 0; type < 3; type++) {
+    if (hierarchy->timed[type])
+      print_latency_histogram(hierarchy->latency_histogram[type], types[type]);
+  }
+}
+
+// cache figures above only cover the sampled sets, these scale them back up to the whole cache
+static void print_sample_stats(const Hierarchy* hierarchy) {
+  printf("\nSet sampling (1 in %lu sets, %lu references skipped)\n\n", hierarchy->sample_ratio, hierarchy->skipped);
+
+  Cache* caches[HIERARCHY_MAX_CACHES];
+  size_t count = _hierarchy_caches(hierarchy, caches);
+
+  for (size_t i = 0; i < count; i++) {
+    if (i) fputc('\n', stdout);
+    print_sample_cache(caches[i], cache_stats(caches[i])->name, hierarchy->sample_ratio);
+  }
+}
+
+// prints the "Simulation statistics" block
+void hierarchy_print_stats(const Hierarchy* hierarchy, const bool verbose) {
+  CacheStats dc_stats;
+  RefStats ref_stats;
+  _hierarchy_totals(hierarchy->dcs, hierarchy->cores, &dc_stats);
+  _hierarchy_ref_stats(hierarchy, &ref_stats);
+  
+  printf("\nSimulation statistics\n\n");
+
+  // PRINT EVERYTHING
+  print_tlb_stats(hierarchy->tlb ? TLB_stats(hierarchy->tlb) : NULL, verbose);
+  fputc('\n', stdout);
+  print_pt_stats(hierarchy->ptable ? ptable_stats(hierarchy->ptable) : NULL, hierarchy->config->pt_type != PTABLE_FLAT);
+  fputc('\n', stdout);
+  for (size_t i = 0; i < hierarchy->cores; i++) {
+    const Cache* dc = hierarchy->dcs[i];
+    const char* name = cache_stats(dc)->name;
+
+    print_cache_stats(cache_stats(dc), name);
+    fputc('\n', stdout);
+    if (cache_miss_stats(dc)) {
+      print_miss_stats(cache_miss_stats(dc), name);
+      fputc('\n', stdout);
+    }
+    if (cache_prefetch_stats(dc)) {
+      print_prefetch_stats(cache_prefetch_stats(dc), name);
+      fputc('\n', stdout);
+    }
+    if (cache_victim_stats(dc)) {
+      print_victim_stats(cache_victim_stats(dc), name);
+      fputc('\n', stdout);
+    }
+    if (cache_mshr_stats(dc)) {
+      print_mshr_stats(cache_mshr_stats(dc), name);
+      fputc('\n', stdout);
+    }
+    if (cache_coherence_stats(dc)) {
+      print_coherence_stats(cache_coherence_stats(dc), name);
+      fputc('\n', stdout);
+    }
+  }
+  for (size_t i = 0; i < hierarchy->cores && hierarchy->L1Is[i]; i++) {
+    print_cache_stats(cache_stats(hierarchy->L1Is[i]), cache_stats(hierarchy->L1Is[i])->name);
+    fputc('\n', stdout);
+  }
+  print_cache_stats(hierarchy->L2 ? cache_stats(hierarchy->L2) : NULL, "L2");
+  fputc('\n', stdout);
+  if (hierarchy->L2 && cache_miss_stats(hierarchy->L2)) {
+    print_miss_stats(cache_miss_stats(hierarchy->L2), "L2");
+    fputc('\n', stdout);
+  }
+  if (hierarchy->L2 && hierarchy->config->report_inclusion) {
+    print_inclusion_stats(cache_stats(hierarchy->L2), "L2");
+    fputc('\n', stdout);
+  }
+  if (hierarchy->L2 && cache_prefetch_stats(hierarchy->L2)) {
+    print_prefetch_stats(cache_prefetch_stats(hierarchy->L2), "L2");
+    fputc('\n', stdout);
+  }
+  for (size_t i = 0; i < hierarchy->num_lower; i++) {
+    const CacheStats* stats = cache_stats(hierarchy->lower[i]);
+
+    print_cache_stats(stats, stats->name);
+    fputc('\n', stdout);
+    if (hierarchy->config->report_inclusion) {
+      print_inclusion_stats(stats, stats->name);
+      fputc('\n', stdout);
+    }
+  }
+  print_rw_stats(_hierarchy_data_reads(hierarchy, &dc_stats), dc_stats.total_accesses - dc_stats.reads, hierarchy->fetches);
+  if (hierarchy->warmup)
+    printf("%-17s: %lu%s\n", "warm-up refs", hierarchy->warmup, hierarchy->references < hierarchy->warmup ? " (not reached)" : "");
+  fputc('\n', stdout);
+  print_ref_stats(&ref_stats);
+
+  if (hierarchy->config->timing)
+    print_timing_stats(hierarchy);
+
+  if (hierarchy->sample_ratio)
+    print_sample_stats(hierarchy);
+}
+
+void hierarchy_print_csv_header(FILE* f) {
+  fprintf(f, "config,rejected,dtlb_hits,dtlb_misses,pt_hits,pt_faults,dc_hits,dc_misses,L2_hits,L2_misses,reads,writes,memory_refs,pt_refs,disk_refs,dtlb_shootdowns,cycles,"
+    "fetches,L1I_hits,L1I_misses,L3_hits,L3_misses,back_invalidations,"
+    "dc_compulsory,dc_capacity,dc_conflict,L2_compulsory,L2_capacity,L2_conflict\n");
+}
+
+// prints the statistics as one CSV record. disabled structures report 0 hits and misses, the dc and L1I columns
+// add up every core. levels below the L3 are only in the statistics block, the 3C columns are 0 without classification.
+void hierarchy_print_csv(const Hierarchy* hierarchy, const char* name, FILE* f) {
+  const TLBStats* tlb_stats = hierarchy->tlb ? TLB_stats(hierarchy->tlb) : NULL;
+  const PTableStats* pt_stats = hierarchy->ptable ? ptable_stats(hierarchy->ptable) : NULL;
+  const CacheStats* L2_stats = hierarchy->L2 ? cache_stats(hierarchy->L2) : NULL;
+  const CacheStats* L3_stats = hierarchy->num_lower ? cache_stats(hierarchy->lower[0]) : NULL;
+  CacheStats dc_stats, L1I_stats;
+  MissStats dc_misses, L2_misses;
+  RefStats ref_stats;
+  _hierarchy_totals(hierarchy->dcs, hierarchy->cores, &dc_stats);
+  _hierarchy_totals(hierarchy->L1Is, hierarchy->cores, &L1I_stats);
+  _hierarchy_miss_totals(hierarchy->dcs, hierarchy->cores, &dc_misses);
+  _hierarchy_miss_totals(&hierarchy->L2, 1, &L2_misses);
+  _hierarchy_ref_stats(hierarchy, &ref_stats);
+
+  // every level below the dc can back-invalidate
+  size_t back_invalidations = L2_stats ? L2_stats->back_invalidations : 0;
+  for (size_t i = 0; i < hierarchy->num_lower; i++)
+    back_invalidations += cache_stats(hierarchy->lower[i])->back_invalidations;
+
+  fprintf(f, "%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+    name,
+    hierarchy->rejected,
+    tlb_stats ? tlb_stats->hits : 0,
+    tlb_stats ? tlb_stats->total_accesses - tlb_stats->hits : 0,
+    pt_stats ? pt_stats->hits : 0,
+    pt_stats ? pt_stats->total_accesses - pt_stats->hits : 0,
+    dc_stats.hits,
+    dc_stats.total_accesses - dc_stats.hits,
+    L2_stats ? L2_stats->hits : 0,
+    L2_stats ? L2_stats->total_accesses - L2_stats->hits : 0,
+    _hierarchy_data_reads(hierarchy, &dc_stats),
+    dc_stats.total_accesses - dc_stats.reads,
+    ref_stats.memory_refs,
+    ref_stats.pt_refs,
+    ref_stats.disk_refs,
+    tlb_stats ? tlb_stats->shootdowns : 0,
+    hierarchy->total_cycles[TRACE_READ] + hierarchy->total_cycles[TRACE_WRITE] + hierarchy->total_cycles[TRACE_FETCH],
+    hierarchy->fetches,
+    L1I_stats.hits,
+    L1I_stats.total_accesses - L1I_stats.hits,
+    L3_stats ? L3_stats->hits : 0,
+    L3_stats ? L3_stats->total_accesses - L3_stats->hits : 0,
+    back_invalidations,
+    dc_misses.compulsory,
+    dc_misses.capacity,
+    dc_misses.conflict,
+    L2_misses.compulsory,
+    L2_misses.capacity,
+    L2_misses.conflict);
+}
+
+void hierarchy_counters(const Hierarchy* hierarchy, HierarchyCounters* counters) {
+  const TLBStats* tlb_stats = hierarchy->tlb ? TLB_stats(hierarchy->tlb) : NULL;
+  const PTableStats* pt_stats = hierarchy->ptable ? ptable_stats(hierarchy->ptable) : NULL;
+  const CacheStats* L2_stats = hierarchy->L2 ? cache_stats(hierarchy->L2) : NULL;
+  CacheStats dc_stats, L1I_stats;
+  RefStats ref_stats;
+  _hierarchy_totals(hierarchy->dcs, hierarchy->cores, &dc_stats);
+  _hierarchy_totals(hierarchy->L1Is, hierarchy->cores, &L1I_stats);
+  _hierarchy_ref_stats(hierarchy, &ref_stats);
+
+  counters->references = hierarchy->references;
+  counters->dc_hits = dc_stats.hits + L1I_stats.hits;
+  counters->dc_accesses = dc_stats.total_accesses + L1I_stats.total_accesses;
+  counters->L2_hits = L2_stats ? L2_stats->hits : 0;
+  counters->L2_accesses = L2_stats ? L2_stats->total_accesses : 0;
+  counters->tlb_hits = tlb_stats ? tlb_stats->hits : 0;
+  counters->tlb_accesses = tlb_stats ? tlb_stats->total_accesses : 0;
+  counters->pt_faults = pt_stats ? pt_stats->total_accesses - pt_stats->hits : 0;
+  counters->memory_refs = ref_stats.memory_refs;
+  counters->disk_refs = ref_stats.disk_refs;
+  counters->cycles = hierarchy->total_cycles[TRACE_READ] + hierarchy->total_cycles[TRACE_WRITE] + hierarchy->total_cycles[TRACE_FETCH];
+}
+
+void hierarchy_print_interval_header(FILE* f) {
+  fprintf(f, "end,references,dc_hits,dc_misses,dc_hit_ratio,L2_hits,L2_misses,L2_hit_ratio,dtlb_hits,dtlb_misses,pt_faults,memory_refs,disk_refs,cycles\n");
+}
+
+// a hit ratio column, left empty when nothing was accessed
+static void _hierarchy_print_ratio(const size_t hits, const size_t accesses, FILE* f) {
+  if (accesses)
+    fprintf(f, "%.6f,", (double) hits / (double) accesses);
+  else
+    fputc(',', f);
+}
+
+void hierarchy_print_interval(const HierarchyCounters* now, const HierarchyCounters* last, FILE* f) {
+  size_t dc_hits = now->dc_hits - last->dc_hits;
+  size_t dc_accesses = now->dc_accesses - last->dc_accesses;
+  size_t L2_hits = now->L2_hits - last->L2_hits;
+  size_t L2_accesses = now->L2_accesses - last->L2_accesses;
+
+  fprintf(f, "%lu,%lu,%lu,%lu,", now->references, now->references - last->references, dc_hits, dc_accesses - dc_hits);
+  _hierarchy_print_ratio(dc_hits, dc_accesses, f);
+  fprintf(f, "%lu,%lu,", L2_hits, L2_accesses - L2_hits);
+  _hierarchy_print_ratio(L2_hits, L2_accesses, f);
+  fprintf(f, "%lu,%lu,%lu,%lu,%lu,%lu\n",
+    now->tlb_hits - last->tlb_hits,
+    (now->tlb_accesses - now->tlb_hits) - (last->tlb_accesses - last->tlb_hits),
+    now->pt_faults - last->pt_faults,
+    now->memory_refs - last->memory_refs,
+    now->disk_refs - last->disk_refs,
+    now->cycles - last->cycles);
+}
+
+// INSTRUMENTATION
+
+static int _hierarchy_compare_pages(const void* a, const void* b) {
+  uint64_t x = ((const PageFaults*) a)->vpage, y = ((const PageFaults*) b)->vpage;
+  return (x > y) - (x < y);
+}
+
+// the pages that faulted sorted by virtual page, returns how many. the caller frees `*pages`
+static size_t _hierarchy_page_faults(const PTable* ptable, PageFaults** pages, uint64_t* untracked) {
+  size_t size, count = 0;
+  const PageFaults* table = ptable_page_faults(ptable, &size, untracked);
+
+  *pages = malloc(sizeof(PageFaults) * size);
+  for (size_t i = 0; i < size; i++)
+    if (table[i].faults) (*pages)[count++] = table[i];
+  qsort(*pages, count, sizeof(PageFaults), _hierarchy_compare_pages);
+
+  return count;
+}
+
+// one JSON array of the per set accesses (`misses` false) or misses, unsimulated sets are null
+static void _hierarchy_json_sets(const Cache* cache, const bool misses, FILE* f) {
+  uint64_t accesses, missed;
+
+  fputc('[', f);
+  for (size_t i = 0; i < cache_num_sets(cache); i++) {
+    if (i) fputc(',', f);
+    if (cache_set_counts(cache, i, &accesses, &missed))
+      fprintf(f, "%lu", misses ? missed : accesses);
+    else
+      fputs("null", f);
+  }
+  fputc(']', f);
+}
+
+static void _hierarchy_json(const Hierarchy* hierarchy, FILE* f) {
+  Cache* caches[HIERARCHY_MAX_CACHES];
+  size_t count = _hierarchy_caches(hierarchy, caches);
+
+  fprintf(f, "{\n  \"references\": %lu,\n  \"caches\": [", hierarchy->references);
+  for (size_t i = 0; i < count; i++) {
+    const ReuseStats* reuse = cache_reuse_stats(caches[i]);
+
+    fprintf(f, "%s\n    {\n      \"name\": \"%s\",\n      \"sets\": %lu,\n      \"set_accesses\": ", i ? "," : "", cache_stats(caches[i])->name, cache_num_sets(caches[i]));
+    _hierarchy_json_sets(caches[i], false, f);
+    fputs(",\n      \"set_misses\": ", f);
+    _hierarchy_json_sets(caches[i], true, f);
+    fputs(",\n      \"reuse_distance\": [", f);
+    for (size_t j = 0; j < CACHE_REUSE_BUCKETS; j++)
+      fprintf(f, "%s%lu", j ? "," : "", reuse->histogram[j]);
+    fprintf(f, "],\n      \"reuse_misses\": %lu\n    }", reuse->misses);
+  }
+  fputs("\n  ],\n  \"page_faults\": ", f);
+
+  if (!hierarchy->ptable) {
+    fputs("null\n}\n", f);
+    return;
+  }
+
+  PageFaults* pages;
+  uint64_t untracked;
+  size_t num_pages = _hierarchy_page_faults(hierarchy->ptable, &pages, &untracked);
+
+  fputs("{\n    \"pages\": [", f);
+  for (size_t i = 0; i < num_pages; i++)
+    fprintf(f, "%s\n      {\"vpage\": %lu, \"faults\": %lu}", i ? "," : "", pages[i].vpage, pages[i].faults);
+  fprintf(f, "%s],\n    \"untracked\": %lu\n  }\n}\n", num_pages ? "\n    " : "", untracked);
+  free(pages);
+}
+
+// long form, one structure,kind,index,value record per counter. unsimulated sets are left out
+static void _hierarchy_csv(const Hierarchy* hierarchy, FILE* f) {
+  Cache* caches[HIERARCHY_MAX_CACHES];
+  size_t count = _hierarchy_caches(hierarchy, caches);
+  uint64_t accesses, misses;
+
+  fputs("structure,kind,index,value\n", f);
+  for (size_t i = 0; i < count; i++) {
+    const char* name = cache_stats(caches[i])->name;
+    const ReuseStats* reuse = cache_reuse_stats(caches[i]);
+
+    for (size_t j = 0; j < cache_num_sets(caches[i]); j++) {
+      if (!cache_set_counts(caches[i], j, &accesses, &misses)) continue;
+      fprintf(f, "%s,set_accesses,%lu,%lu\n%s,set_misses,%lu,%lu\n", name, j, accesses, name, j, misses);
+    }
+    for (size_t j = 0; j < CACHE_REUSE_BUCKETS; j++)
+      fprintf(f, "%s,reuse_distance,%lu,%lu\n", name, j, reuse->histogram[j]);
+    fprintf(f, "%s,reuse_misses,,%lu\n", name, reuse->misses);
+  }
+
+  if (!hierarchy->ptable) return;
+
+  PageFaults* pages;
+  uint64_t untracked;
+  size_t num_pages = _hierarchy_page_faults(hierarchy->ptable, &pages, &untracked);
+
+  for (size_t i = 0; i < num_pages; i++)
+    fprintf(f, "pt,page_faults,%lu,%lu\n", pages[i].vpage, pages[i].faults);
+  fprintf(f, "pt,untracked_faults,,%lu\n", untracked);
+  free(pages);
+}
+
+bool hierarchy_write_instrumentation(const Hierarchy* hierarchy, const char* filename) {
+  FILE* f = fopen(filename, "w");
+  if (!f) {
+    perror("Failed to open instrumentation file");
+    return false;
+  }
+
+  size_t length = strlen(filename);
+  if (length >= 4 && !strcmp(filename + length - 4, ".csv"))
+    _hierarchy_csv(hierarchy, f);
+  else
+    _hierarchy_json(hierarchy, f);
+
+  if (fclose(f)) {
+    perror("Failed to write instrumentation file");
+    return false;
+  }
+
+  return true;
+}
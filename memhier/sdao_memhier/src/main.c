@@ -2,211 +2,429 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include "config.h"
-#include "cache.h"
-#include "ptable.h"
-#include "tlb.h"
+#include "config_consts.h"
+#include "hierarchy.h"
+#include "stackdist.h"
+#include "sweep.h"
+#include "trace.h"
+#include "tracegen.h"
 #include "util.h"
+#include "writer.h"
 
-#define LINESIZE 20
+#define STACKDIST_DEFAULT_WAYS (4 * MAX_ASSOCIATIVITY)
 
-struct RefStats {
-  size_t memory_refs;
-  size_t pt_refs;
-  size_t disk_refs;
-};
+void print_usage(const char* name) {
+  fprintf(stderr, "Usage: %s [-q] [-v] [-S ratio | -p threads] [-W warmup] [-I interval:file] [-i file] [-r snapshot] [-w snapshot] [-b binary_trace]\n", name);
+  fprintf(stderr, "       %s -s [-j threads] [-b binary_trace] config...\n", name);
+  fprintf(stderr, "       %s -d sets:line_size[:max_ways] [-b binary_trace]\n", name);
+  fprintf(stderr, "       %s -c binary_trace < text_trace\n", name);
+  fprintf(stderr, "       %s -g pattern[,key=value...] [-c binary_trace]\n\n", name);
+  fprintf(stderr, "  -b <file>  read references from a binary trace instead of stdin\n");
+  fprintf(stderr, "  -c <file>  convert a text trace on stdin into a binary trace and exit\n");
+  fprintf(stderr, "  -g <spec>  write a synthetic trace to stdout (or the -c file) and exit, the pattern is one of\n");
+  fprintf(stderr, "             sequential, strided, uniform, zipf or chase. keys are count, base, footprint, stride,\n");
+  fprintf(stderr, "             line, alpha (zipf exponent), writes (fraction) and seed\n");
+  fprintf(stderr, "  -q         quiet, only print the simulation statistics\n");
+  fprintf(stderr, "  -v         also print the statistics memhier_ref doesn't have (dtlb shootdowns)\n");
+  fprintf(stderr, "  -S <n>     set sampling, only simulate every nth dc/L2 set and extrapolate miss ratios\n");
+  fprintf(stderr, "  -p <n>     split the dc/L2 sets of a physical address trace across n threads, implies -q\n");
+  fprintf(stderr, "  -W <n>     the first n references only warm up the hierarchy, every counter is reset after them\n");
+  fprintf(stderr, "  -I <n:file> write the hit ratios, misses and memory refs of every n references as CSV to file\n");
+  fprintf(stderr, "  -i <file>  write per set accesses and misses, reuse distances and page faults per page to file\n");
+  fprintf(stderr, "             at exit, as JSON or as CSV when the name ends in .csv\n");
+  fprintf(stderr, "  -r <file>  restore the hierarchy from a snapshot before simulating the trace\n");
+  fprintf(stderr, "  -w <file>  save the hierarchy to a snapshot after simulating the trace\n");
+  fprintf(stderr, "  -s         sweep every config file given over one pass of the trace, prints CSV\n");
+  fprintf(stderr, "  -j <n>     number of sweep worker threads (default: one per CPU)\n");
+  fprintf(stderr, "  -d <geom>  LRU stack distance analysis, prints hit ratios for 1 to max_ways ways (default %lu)\n", STACKDIST_DEFAULT_WAYS);
+}
 
-typedef struct RefStats RefStats;
+// runs the stack distance analysis described by "sets:line_size[:max_ways]" over the trace
+int run_stackdist(Trace* trace, const char* geometry) {
+  size_t num_sets, line_size, max_ways = STACKDIST_DEFAULT_WAYS;
 
-void print_cache_stats(const CacheStats* stats, const char* name) {
-  printf("%2s %-14s: %lu\n", name, "hits", stats ? stats->hits : 0);
-  printf("%2s %-14s: %lu\n", name, "misses", stats ? (stats->total_accesses - stats->hits) : 0);
+  if (sscanf(geometry, "%lu:%lu:%lu", &num_sets, &line_size, &max_ways) < 2 || !max_ways) {
+    fprintf(stderr, "Expected \"sets:line_size[:max_ways]\" for -d.\n");
+    return 1;
+  }
 
-  if (stats)
-    printf("%2s %-14s: %lf\n", name, "hit ratio", (double) stats->hits / (double) stats->total_accesses);
-  else
-    printf("%2s %-14s: %s\n", name, "hit ratio", "N/A");
-}
+  if (!num_sets || (num_sets & (num_sets - 1)) || !line_size || (line_size & (line_size - 1))) {
+    fprintf(stderr, "Number of sets and line size should be powers of 2.\n");
+    return 1;
+  }
 
-void print_rw_stats(const size_t reads, const size_t writes) {
-  printf("%-17s: %lu\n", "Total reads", reads);
-  printf("%-17s: %lu\n", "Total writes", writes);
-  printf("%-17s: %lf\n", "Ratio of reads", (double) reads / (double)(reads + writes));
-}
+  StackDist* sd = stackdist_new(num_sets, line_size, max_ways);
+  TraceStatus status;
+  TraceAccess access;
+  uint64_t address;
+  uint32_t core;
 
-void print_pt_stats(const PTableStats* ptable) {
-  printf("%-17s: %lu\n", "pt hits", ptable ? ptable->hits : 0);
-  printf("%-17s: %lu\n", "pt faults", ptable ? (ptable->total_accesses - ptable->hits) : 0);
-  if (ptable)
-    printf("%-17s: %lf\n", "pt hit ratio", (double) ptable->hits / (double) ptable->total_accesses); 
-  else
-    printf("%-17s: %s\n", "pt hit ratio", "N/A");
-}
+  while ((status = trace_next(trace, &access, &address, &core)) != TRACE_END) {
+    if (status == TRACE_SKIP) {
+      fprintf(stderr, "failed to parse\n");
+      continue;
+    }
 
-void print_ref_stats(const RefStats* ref_stats) {
-  printf("%-17s: %lu\n", "main memory refs", ref_stats->memory_refs); 
-  printf("%-17s: %lu\n", "page table refs", ref_stats->pt_refs);
-  printf("%-17s: %lu\n", "disk refs", ref_stats->disk_refs);
-}
+    if (status == TRACE_BAD_TYPE) {
+      printf("hierarchy: unexpected access type\n");
+      stackdist_free(sd);
+      return 1;
+    }
+
+    if (address > UINT32_MAX) {
+      fprintf(stderr, "physical address too large\n");
+      continue;
+    }
 
-void print_tlb_stats(const TLBStats* tlb_stats) {
+    stackdist_access(sd, address);
+  }
 
-  printf("%-17s: %lu\n", "dtlb hits", tlb_stats ? tlb_stats->hits : 0);
-  printf("%-17s: %lu\n", "dtlb misses", tlb_stats ? (tlb_stats->total_accesses - tlb_stats->hits) : 0);
-  
-  if (tlb_stats)
-    printf("%-17s: %lf\n", "dtlb hit ratio", (double) tlb_stats->hits / (double) tlb_stats->total_accesses);
-  else
-    printf("%-17s: %s\n", "dtlb hit ratio" , "N/A");
+  stackdist_print(sd, stdout);
+  stackdist_free(sd);
+  return 0;
 }
 
+int main(int argc, char** argv) {
+  const char* binary_trace = NULL;
+  const char* convert_trace = NULL;
+  const char* generate_spec = NULL;
+  const char* restore_snapshot = NULL;
+  const char* save_snapshot = NULL;
+  bool quiet = false;
+  bool verbose = false;
+  bool sweep = false;
+  long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  const char* stackdist_geometry = NULL;
+  long sample_ratio = 1;
+  long parts = 1;
+  long warmup = 0;
+  long interval = 0;
+  const char* interval_file = NULL;
+  const char* instrument_file = NULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "b:c:g:qvsj:d:S:p:r:w:W:I:i:")) != -1) {
+    switch (opt) {
+      case 'b':
+        binary_trace = optarg;
+        break;
+      case 'c':
+        convert_trace = optarg;
+        break;
+      case 'g':
+        generate_spec = optarg;
+        break;
+      case 'q':
+        quiet = true;
+        break;
+      case 'v':
+        verbose = true;
+        break;
+      case 's':
+        sweep = true;
+        break;
+      case 'j':
+        num_threads = strtol(optarg, NULL, 10);
+        if (num_threads < 1) {
+          fprintf(stderr, "Expected a positive number of threads.\n");
+          return 1;
+        }
+        break;
+      case 'd':
+        stackdist_geometry = optarg;
+        break;
+      case 'S':
+        sample_ratio = strtol(optarg, NULL, 10);
+        if (sample_ratio < 1 || (sample_ratio & (sample_ratio - 1))) {
+          fprintf(stderr, "Expected a power of 2 sampling ratio.\n");
+          return 1;
+        }
+        break;
+      case 'p':
+        parts = strtol(optarg, NULL, 10);
+        if (parts < 1 || (parts & (parts - 1))) {
+          fprintf(stderr, "Expected a power of 2 number of partitions.\n");
+          return 1;
+        }
+        break;
+      case 'W':
+        warmup = strtol(optarg, NULL, 10);
+        if (warmup < 0) {
+          fprintf(stderr, "Expected a non-negative number of warm-up references.\n");
+          return 1;
+        }
+        break;
+      case 'I': {
+        int n = 0;
+        if (sscanf(optarg, "%ld:%n", &interval, &n) != 1 || !n || interval < 1 || !optarg[n]) {
+          fprintf(stderr, "Expected \"interval:file\" with a positive interval for -I.\n");
+          return 1;
+        }
+        interval_file = optarg + n;
+        break;
+      }
+      case 'i':
+        instrument_file = optarg;
+        break;
+      case 'r':
+        restore_snapshot = optarg;
+        break;
+      case 'w':
+        save_snapshot = optarg;
+        break;
+      default:
+        print_usage(argv[0]);
+        return 1;
+    }
+  }
+
+  // GENERATE ONLY
+  if (generate_spec) {
+    TraceGenSpec spec;
+    if (!tracegen_parse(generate_spec, &spec)) return 1;
+
+    if (!convert_trace)
+      return tracegen_text(&spec, stdout) ? 0 : 1;
+
+    long count = tracegen_binary(&spec, convert_trace);
+    if (count < 0) return 1;
+
+    fprintf(stderr, "Wrote %ld references to %s\n", count, convert_trace);
+    return 0;
+  }
+
+  // CONVERT ONLY
+  if (convert_trace) {
+    long count = trace_convert(stdin, convert_trace);
+    if (count < 0) return 1;
+
+    fprintf(stderr, "Wrote %ld references to %s\n", count, convert_trace);
+    return 0;
+  }
+
+  if (sweep && optind == argc) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  if ((restore_snapshot || save_snapshot) && (sweep || stackdist_geometry || parts > 1)) {
+    fprintf(stderr, "Snapshots only work with a single hierarchy, not with -s, -d or -p.\n");
+    return 1;
+  }
+
+  if (interval && (sweep || stackdist_geometry || parts > 1)) {
+    fprintf(stderr, "Interval statistics only work with a single hierarchy, not with -s, -d or -p.\n");
+    return 1;
+  }
+
+  if (instrument_file && (sweep || stackdist_geometry || parts > 1)) {
+    fprintf(stderr, "Instrumentation only works with a single hierarchy, not with -s, -d or -p.\n");
+    return 1;
+  }
+
+  Trace* trace = binary_trace ? trace_open_binary(binary_trace) : trace_open_text(stdin);
+  if (!trace) return 1;
+
+  // STACK DISTANCE ANALYSIS
+  if (stackdist_geometry) {
+    int ret = run_stackdist(trace, stackdist_geometry);
+    trace_close(trace);
+    return ret;
+  }
+
+  // SWEEP
+  if (sweep) {
+    int ret = sweep_run(trace, argv + optind, argc - optind, num_threads < 1 ? 1 : num_threads, warmup, stdout);
+    trace_close(trace);
+    return ret;
+  }
 
-int main() {
   Config* config = read_config("trace.config");
   if (!config) return 1;
 
-  print_config(config);
-  
-  // PAGE TABLE
-  PTable* ptable = config->virtual_addresses ? ptable_new(config->pt_num_vpages, config->pt_num_ppages, config->pt_page_size) : NULL;
+  // -p implies -q
+  if (!quiet && parts == 1)
+    print_config(config);
 
-  // TLB
-  TLB* tlb = config->use_tlb ? TLB_new(ptable, config->tlb_num_sets, config->tlb_set_size, config->pt_page_size) : NULL;
-  
-  if (ptable && tlb)
-    ptable_connect_tlb(ptable, tlb); 
+  // SET PARTITIONED
+  if (parts > 1) {
+    bool ok;
+    Hierarchy* merged = sweep_partitioned(trace, config, parts, warmup, &ok);
+    if (merged) {
+      hierarchy_print_stats(merged, verbose);
+      hierarchy_free(merged);
+    }
 
-  // DC CACHE
-  Cache* dc = cache_new(config->dc_num_sets, config->dc_set_size, config->dc_line_size, config->dc_write ? WRITE_THROUGH : WRITE_BACK, config->dc_write ? NO_WRALLOC : WRALLOC);
-  if (!dc) {
-    fprintf(stderr, "Failed to initialize dc\n");
-    return 1;
+    trace_close(trace);
+    free_config(config);
+    return merged && ok ? 0 : 1;
   }
   
-  // L2 CACHE
-  Cache* L2 = NULL;
-  if (config->use_L2) {
-    L2 = cache_new(config->L2_num_sets, config->L2_set_size, config->L2_line_size, config->L2_write ? WRITE_THROUGH : WRITE_BACK, config->L2_write ? NO_WRALLOC : WRALLOC);
-    if (!L2) {
-      fprintf(stderr, "Failed to initialize L2\n");
+  Hierarchy* hierarchy = hierarchy_new(config);
+  if (!hierarchy) return 1;
+
+  if (sample_ratio > 1 && !hierarchy_sample(hierarchy, sample_ratio)) return 1;
+  if (instrument_file) hierarchy_instrument(hierarchy);
+  if (restore_snapshot && !hierarchy_load(hierarchy, restore_snapshot)) return 1;
+  hierarchy_warmup(hierarchy, warmup);
+
+  // INTERVALS
+  FILE* intervals = NULL;
+  HierarchyCounters last, now;
+  if (interval) {
+    intervals = fopen(interval_file, "w");
+    if (!intervals) {
+      perror("Failed to open interval file");
       return 1;
     }
 
-    // CONNECT CACHES
-    cache_connect(dc, L2);
-    if (ptable) ptable_connect_cache(ptable, L2);
-  } else {
-    if (ptable) ptable_connect_cache(ptable, dc);
+    hierarchy_print_interval_header(intervals);
+    hierarchy_counters(hierarchy, &last);
   }
 
-  
-  char* buf = malloc(LINESIZE);
-  size_t size = LINESIZE;
-  char read_write;
-  uint32_t address; 
+  TraceStatus status;
+  TraceAccess access;
+  uint64_t address; 
   uint32_t paddress;
+  uint32_t core;
 
   // STATS
-  CacheStats* dc_stats = cache_stats(dc);
-  CacheStats* L2_stats = config->use_L2 ? cache_stats(L2) : NULL;
-  PTableStats* pt_stats = config->virtual_addresses ? ptable_stats(ptable) : NULL;
-  TLBStats* tlb_stats = config->use_tlb ? TLB_stats(tlb) : NULL;
+  CacheStats* L2_stats = hierarchy->L2 ? cache_stats(hierarchy->L2) : NULL;
+  PTableStats* pt_stats = hierarchy->ptable ? ptable_stats(hierarchy->ptable) : NULL;
+  TLBStats* tlb_stats = hierarchy->tlb ? TLB_stats(hierarchy->tlb) : NULL;
 
-  strcpy(dc_stats->name, "dc");
-  if (L2) strcpy(L2_stats->name, "L2");
-  
   size_t num_offset_bits = log_2(config->pt_page_size);
   size_t num_page_bits = log_2(config->pt_num_ppages);
   uint32_t offset_mask = ~((~0u) << num_offset_bits);
   uint32_t page_mask = ~(~(0u) << num_page_bits);
 
-  printf("%-8s Virt.  Page TLB    TLB TLB  PT   Phys        DC  DC          L2  L2\n", config->virtual_addresses ? "Virtual" : "Physical");
-  printf("Address  Page # Off  Tag    Ind Res. Res. Pg # DC Tag Ind Res. L2 Tag Ind Res.\n");
-  printf("-------- ------ ---- ------ --- ---- ---- ---- ------ --- ---- ------ --- ----\n");
+  Writer* rows = writer_new(stdout);
+  int ret = 0;
+
+  if (!quiet) {
+    printf("%-8s Virt.  Page TLB    TLB TLB  PT   Phys        DC  DC          L2  L2\n", config->virtual_addresses ? "Virtual" : "Physical");
+    printf("Address  Page # Off  Tag    Ind Res. Res. Pg # DC Tag Ind Res. L2 Tag Ind Res.\n");
+    printf("-------- ------ ---- ------ --- ---- ---- ---- ------ --- ---- ------ --- ----\n");
+  }
 
-  while (getline(&buf, &size, stdin) != -1) {
-    if (sscanf(buf, "%c:%x", &read_write, &address) != 2) {
+  while ((status = trace_next(trace, &access, &address, &core)) != TRACE_END) {
+    if (status == TRACE_SKIP) {
       fprintf(stderr, "failed to parse\n");
       continue;
     }
-  
-    bool write;
-    switch (read_write) {
-      case 'W':
-        write = true;
-        break;
-      case 'R':
-        write = false;
-        break;
-      default:
-        printf("hierarchy: unexpected access type\n");
-        goto cleanup;
+
+    if (status == TRACE_BAD_TYPE) {
+      writer_flush(rows);
+      printf("hierarchy: unexpected access type\n");
+      goto cleanup;
     }
 
-    // ADDRESS TRANSLATION
-    if (config->virtual_addresses) {
-      // check if the virtual address is too large
-      if (address > config->pt_page_size * config->pt_num_vpages) {
-        fprintf(stderr, "virtual address too large\n");
-        continue;
+    HierarchyResult result = hierarchy_access(hierarchy, core, access, address, &paddress);
+
+    // intervals start counting once the warm-up is over
+    if (intervals) {
+      if (hierarchy->references == hierarchy->warmup) {
+        hierarchy_counters(hierarchy, &last);
+      } else if (hierarchy->references > hierarchy->warmup && hierarchy->references - last.references == (size_t) interval) {
+        hierarchy_counters(hierarchy, &now);
+        hierarchy_print_interval(&now, &last, intervals);
+        last = now;
       }
+    }
 
-      paddress = config->use_tlb ? TLB_virt_phys(tlb, address, write) : ptable_virt_phys(ptable, address, write); 
+    if (result == HIERARCHY_REJECTED) {
+      fprintf(stderr, "%s address too large\n", config->virtual_addresses ? "virtual" : "physical");
+      continue;
     }
-    else {
-      // check if the physical address is too large
-      if (address > config->pt_page_size * config->pt_num_ppages) {
-        fprintf(stderr, "physical address too large\n");
-        continue;
-      }
-      paddress = address;
+
+    if (result == HIERARCHY_BAD_CORE) {
+      fprintf(stderr, "core %u out of range\n", core);
+      continue;
     }
 
-    // reset inserts
-    dc_stats->hit = false;
-    if (config->use_L2)
-      L2_stats->hit = false;
-  
-    // CACHE ACCESS
-    if (write)
-      cache_write(dc, paddress, true);
-    else
-      cache_read(dc, paddress);
+    // references outside the sampled sets have no cache columns to print
+    if (result == HIERARCHY_SKIPPED) continue;
 
     // PRINT
+    if (quiet) continue;
+
     if (!config->virtual_addresses) {
-      printf("%08x        %4x                      %4x %6x %3x %-5s", paddress, paddress & offset_mask, (paddress >> num_offset_bits) & page_mask, dc_stats->tag, dc_stats->index, dc_stats->hit ? "hit" : "miss"); 
+      writer_hex(rows, paddress, 8, true);
+      writer_spaces(rows, 8);
+      writer_hex(rows, paddress & offset_mask, 4, false);
+      writer_spaces(rows, 22);
+      writer_hex(rows, (paddress >> num_offset_bits) & page_mask, 4, false);
     } else if (config->use_tlb) {
-      printf("%08x %6x %4x %6x %3x %-4s %-4s %4x %6x %3x %-5s", address, tlb_stats->vpage, tlb_stats->offset, tlb_stats->tag, tlb_stats->index, tlb_stats->hit ? "hit": "miss", tlb_stats->hit ? "    " : (pt_stats->hit ? "hit" : "miss"), tlb_stats->ppage, dc_stats->tag, dc_stats->index, dc_stats->hit ? "hit" : "miss");
+      writer_hex(rows, address, 8, true);
+      writer_char(rows, ' ');
+      writer_hex(rows, tlb_stats->vpage, 6, false);
+      writer_char(rows, ' ');
+      writer_hex(rows, tlb_stats->offset, 4, false);
+      writer_char(rows, ' ');
+      writer_hex(rows, tlb_stats->tag, 6, false);
+      writer_char(rows, ' ');
+      writer_hex(rows, tlb_stats->index, 3, false);
+      writer_char(rows, ' ');
+      writer_str(rows, tlb_stats->hit ? "hit" : "miss", 4);
+      writer_char(rows, ' ');
+      writer_str(rows, tlb_stats->hit ? "    " : (pt_stats->hit ? "hit" : "miss"), 4);
+      writer_char(rows, ' ');
+      writer_hex(rows, tlb_stats->ppage, 4, false);
     } else {
-      printf("%08x %6x %4x                 %-4s %4x %6x %3x %-5s", address, pt_stats->vpage, pt_stats->offset, pt_stats->hit ? "hit" : "miss", pt_stats->ppage, dc_stats->tag, dc_stats->index, dc_stats->hit ? "hit" : "miss");
+      writer_hex(rows, address, 8, true);
+      writer_char(rows, ' ');
+      writer_hex(rows, pt_stats->vpage, 6, false);
+      writer_char(rows, ' ');
+      writer_hex(rows, pt_stats->offset, 4, false);
+      writer_spaces(rows, 17);
+      writer_str(rows, pt_stats->hit ? "hit" : "miss", 4);
+      writer_char(rows, ' ');
+      writer_hex(rows, pt_stats->ppage, 4, false);
     }
 
-    if (config->use_L2 && (L2_stats->hit || !dc_stats->hit))
-      printf("%6x %3x %-4s\n", L2_stats->tag, L2_stats->index, L2_stats->hit ? "hit" : "miss");
-    else
-      printf("\n");
+    // DC columns are shared by every layout, they come from the dc (the L1I for fetches) of the reference's core
+    const CacheStats* dc_stats = cache_stats(hierarchy_l1(hierarchy, core, access));
+    writer_char(rows, ' ');
+    writer_hex(rows, dc_stats->tag, 6, false);
+    writer_char(rows, ' ');
+    writer_hex(rows, dc_stats->index, 3, false);
+    writer_char(rows, ' ');
+    writer_str(rows, dc_stats->hit ? "hit" : "miss", 5);
+
+    // misses the victim cache or a stream buffer served never reached the L2
+    if (config->use_L2 && !dc_stats->buffered && (L2_stats->hit || !dc_stats->hit)) {
+      writer_hex(rows, L2_stats->tag, 6, false);
+      writer_char(rows, ' ');
+      writer_hex(rows, L2_stats->index, 3, false);
+      writer_char(rows, ' ');
+      writer_str(rows, L2_stats->hit ? "hit" : "miss", 4);
+    }
+    writer_char(rows, '\n');
   }
 
-  RefStats ref_stats;
-  ref_stats.memory_refs = config->use_L2 ? L2_stats->mem_accesses : dc_stats->mem_accesses;
-  ref_stats.pt_refs = pt_stats ? pt_stats->total_accesses : 0;
-  ref_stats.disk_refs = pt_stats ? pt_stats->disk_accesses : 0;
-  
-  printf("\nSimulation statistics\n\n");
-
-  // PRINT EVERYTHING
-  print_tlb_stats(tlb_stats);
-  fputc('\n', stdout);
-  print_pt_stats(pt_stats);
-  fputc('\n', stdout);
-  print_cache_stats(dc_stats, "dc");
-  fputc('\n', stdout);
-  print_cache_stats(L2_stats, "L2");
-  fputc('\n', stdout);
-  print_rw_stats(dc_stats->reads, dc_stats->total_accesses - dc_stats->reads);
-  fputc('\n', stdout);
-  print_ref_stats(&ref_stats);
+  // rows have to reach stdout before the statistics
+  if (!writer_free(rows)) ret = 1;
+  rows = NULL;
+
+  // the last interval can be shorter
+  if (intervals && hierarchy->references > hierarchy->warmup && hierarchy->references > last.references) {
+    hierarchy_counters(hierarchy, &now);
+    hierarchy_print_interval(&now, &last, intervals);
+  }
+
+  if (save_snapshot && !hierarchy_save(hierarchy, save_snapshot)) {
+    ret = 1;
+    goto cleanup;
+  }
+
+  if (instrument_file && !hierarchy_write_instrumentation(hierarchy, instrument_file)) {
+    ret = 1;
+    goto cleanup;
+  }
+
+  hierarchy_print_stats(hierarchy, verbose);
 
 
   // REQUIREMENTS
@@ -215,7 +433,10 @@ int main() {
   // LRU replacement for TLB, DC, L2, and Page Table
   // PAGE FAULT: Invalidate associated TLB, DC, and L2 entries 
 cleanup:
+  if (rows && !writer_free(rows)) ret = 1;
+  if (intervals) fclose(intervals);
+  trace_close(trace);
+  hierarchy_free(hierarchy);
   free_config(config);
-  cache_free(dc);
-  if (L2) cache_free(L2);
+  return ret;
 }
@@ -0,0 +1,77 @@
+#include <stdlib.h>
+#include "mshr.h"
+#include "snapshot.h"
+
+MSHRFile* mshr_new(const size_t entries, const uint64_t miss_time) {
+  MSHRFile* mshr = calloc(1, sizeof(MSHRFile));
+  mshr->entries = entries;
+  mshr->miss_time = miss_time;
+
+  return mshr;
+}
+
+void mshr_free(MSHRFile* mshr) {
+  free(mshr);
+}
+
+void mshr_reset(MSHRFile* mshr) {
+  mshr->count = 0;
+}
+
+bool mshr_save(const MSHRFile* mshr, FILE* f) {
+  return snapshot_write(f, &mshr->count, sizeof(mshr->count))
+    && snapshot_write(f, mshr->lines, sizeof(mshr->lines))
+    && snapshot_write(f, mshr->done, sizeof(mshr->done));
+}
+
+bool mshr_load(MSHRFile* mshr, FILE* f) {
+  if (!snapshot_read(f, &mshr->count, sizeof(mshr->count)) || mshr->count > mshr->entries) return false;
+
+  return snapshot_read(f, mshr->lines, sizeof(mshr->lines))
+    && snapshot_read(f, mshr->done, sizeof(mshr->done));
+}
+
+// frees the entries whose line has arrived by `now`
+static void _mshr_retire(MSHRFile* mshr, const uint64_t now) {
+  for (size_t i = 0; i < mshr->count;) {
+    if (mshr->done[i] > now) {
+      i++;
+      continue;
+    }
+
+    mshr->count -= 1;
+    mshr->lines[i] = mshr->lines[mshr->count];
+    mshr->done[i] = mshr->done[mshr->count];
+  }
+}
+
+bool mshr_pending(MSHRFile* mshr, const uint32_t line, const uint64_t now) {
+  _mshr_retire(mshr, now);
+
+  for (size_t i = 0; i < mshr->count; i++) {
+    if (mshr->lines[i] == line) return true;
+  }
+
+  return false;
+}
+
+bool mshr_allocate(MSHRFile* mshr, const uint32_t line, const uint64_t now) {
+  _mshr_retire(mshr, now);
+
+  if (mshr->count < mshr->entries) {
+    mshr->lines[mshr->count] = line;
+    mshr->done[mshr->count] = now + mshr->miss_time;
+    mshr->count += 1;
+    return true;
+  }
+
+  // stall until the oldest miss is done, this one starts then
+  size_t oldest = 0;
+  for (size_t i = 1; i < mshr->count; i++) {
+    if (mshr->done[i] < mshr->done[oldest]) oldest = i;
+  }
+
+  mshr->lines[oldest] = line;
+  mshr->done[oldest] += mshr->miss_time;
+  return false;
+}
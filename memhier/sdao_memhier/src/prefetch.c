@@ -0,0 +1,176 @@
+#include <stdlib.h>
+#include <string.h>
+#include "prefetch.h"
+#include "snapshot.h"
+#include "util.h"
+
+static const char* policy_names[] = {
+  [PREFETCH_NONE] = "none",
+  [PREFETCH_NEXT_LINE] = "next-line",
+  [PREFETCH_STRIDE] = "stride",
+  [PREFETCH_STREAM] = "stream",
+};
+
+Prefetcher* prefetcher_new(const PrefetchPolicy policy, const size_t degree, const size_t line_size) {
+  Prefetcher* prefetcher = calloc(1, sizeof(Prefetcher));
+  prefetcher->policy = policy;
+  prefetcher->degree = degree;
+  prefetcher->line_bits = log_2(line_size);
+
+  if (policy == PREFETCH_STRIDE)
+    prefetcher->table = malloc(sizeof(StrideEntry) * PREFETCH_STRIDE_ENTRIES);
+
+  prefetcher_reset(prefetcher);
+  return prefetcher;
+}
+
+void prefetcher_free(Prefetcher* prefetcher) {
+  free(prefetcher->table);
+  free(prefetcher);
+}
+
+void prefetcher_reset(Prefetcher* prefetcher) {
+  if (prefetcher->table)
+    memset(prefetcher->table, 0, sizeof(StrideEntry) * PREFETCH_STRIDE_ENTRIES);
+  memset(prefetcher->buffers, 0, sizeof(prefetcher->buffers));
+}
+
+bool prefetcher_save(const Prefetcher* prefetcher, FILE* f) {
+  return (!prefetcher->table || snapshot_write(f, prefetcher->table, sizeof(StrideEntry) * PREFETCH_STRIDE_ENTRIES))
+    && snapshot_write(f, prefetcher->buffers, sizeof(prefetcher->buffers));
+}
+
+// stride entries have to hold a valid byte of 0 or 1 and stream buffers a ring within the degree
+bool prefetcher_load(Prefetcher* prefetcher, FILE* f) {
+  if ((prefetcher->table && !snapshot_read(f, prefetcher->table, sizeof(StrideEntry) * PREFETCH_STRIDE_ENTRIES))
+      || !snapshot_read(f, prefetcher->buffers, sizeof(prefetcher->buffers)))
+    return false;
+
+  for (size_t i = 0; prefetcher->table && i < PREFETCH_STRIDE_ENTRIES; i++) {
+    uint8_t valid;
+    memcpy(&valid, &prefetcher->table[i].valid, 1);
+    if (valid > 1) return false;
+  }
+
+  for (size_t i = 0; i < PREFETCH_STREAM_BUFFERS; i++) {
+    const StreamBuffer* buffer = prefetcher->buffers + i;
+    if (buffer->first >= prefetcher->degree || buffer->count > prefetcher->degree) return false;
+  }
+
+  return true;
+}
+
+static size_t _prefetcher_next_line(const Prefetcher* prefetcher, const uint32_t line, const bool trigger, uint32_t* lines) {
+  if (!trigger) return 0;
+
+  for (size_t i = 0; i < prefetcher->degree; i++)
+    lines[i] = line + 1 + i;
+
+  return prefetcher->degree;
+}
+
+static size_t _prefetcher_stride(Prefetcher* prefetcher, const uint32_t line, uint32_t* lines) {
+  uint32_t region = line >> (PREFETCH_REGION_BITS > prefetcher->line_bits ? PREFETCH_REGION_BITS - prefetcher->line_bits : 0);
+  StrideEntry* entry = prefetcher->table + region % PREFETCH_STRIDE_ENTRIES;
+
+  // a new region takes over the entry
+  if (!entry->valid || entry->region != region) {
+    entry->valid = true;
+    entry->region = region;
+    entry->last_line = line;
+    entry->stride = 0;
+    entry->confidence = 0;
+    return 0;
+  }
+
+  int32_t stride = (int32_t)(line - entry->last_line);
+  entry->last_line = line;
+  if (!stride) return 0;
+
+  if (stride == entry->stride) {
+    if (entry->confidence < PREFETCH_STRIDE_CONFIDENT) entry->confidence += 1;
+  } else {
+    entry->stride = stride;
+    entry->confidence = 0;
+  }
+
+  if (entry->confidence < PREFETCH_STRIDE_CONFIDENT) return 0;
+
+  for (size_t i = 0; i < prefetcher->degree; i++)
+    lines[i] = line + (uint32_t) stride * (i + 1);
+
+  return prefetcher->degree;
+}
+
+// replaces the least recently used buffer with the lines after `line`
+static size_t _prefetcher_stream(Prefetcher* prefetcher, const uint32_t line, const uint64_t now, uint32_t* lines, size_t* dropped) {
+  StreamBuffer* buffer = prefetcher->buffers;
+  for (size_t i = 1; i < PREFETCH_STREAM_BUFFERS; i++) {
+    if (prefetcher->buffers[i].last_use < buffer->last_use)
+      buffer = prefetcher->buffers + i;
+  }
+
+  *dropped = buffer->count;
+  buffer->first = 0;
+  buffer->count = prefetcher->degree;
+  buffer->last_use = now;
+
+  for (size_t i = 0; i < prefetcher->degree; i++) {
+    lines[i] = buffer->lines[i] = line + 1 + i;
+    buffer->times[i] = now;
+  }
+
+  return prefetcher->degree;
+}
+
+size_t prefetcher_access(Prefetcher* prefetcher, const uint32_t line, const bool trigger, const uint64_t now, uint32_t* lines, size_t* dropped) {
+  *dropped = 0;
+
+  switch (prefetcher->policy) {
+    case PREFETCH_NEXT_LINE:
+      return _prefetcher_next_line(prefetcher, line, trigger, lines);
+    case PREFETCH_STRIDE:
+      return _prefetcher_stride(prefetcher, line, lines);
+    case PREFETCH_STREAM:
+      return trigger ? _prefetcher_stream(prefetcher, line, now, lines, dropped) : 0;
+    default:
+      return 0;
+  }
+}
+
+bool prefetcher_stream_take(Prefetcher* prefetcher, const uint32_t line, const uint64_t now, uint64_t* fetched, uint32_t* refill) {
+  if (prefetcher->policy != PREFETCH_STREAM) return false;
+
+  for (size_t i = 0; i < PREFETCH_STREAM_BUFFERS; i++) {
+    StreamBuffer* buffer = prefetcher->buffers + i;
+    if (!buffer->count || buffer->lines[buffer->first] != line) continue;
+
+    // the head moves into the cache and the tail fetches the next line in its place
+    size_t tail = (buffer->first + buffer->count - 1) % prefetcher->degree;
+    *fetched = buffer->times[buffer->first];
+    *refill = buffer->lines[tail] + 1;
+
+    buffer->lines[buffer->first] = *refill;
+    buffer->times[buffer->first] = now;
+    buffer->first = (buffer->first + 1) % prefetcher->degree;
+    buffer->last_use = now;
+    return true;
+  }
+
+  return false;
+}
+
+bool prefetch_policy_parse(const char* name, PrefetchPolicy* policy) {
+  for (size_t i = 0; i < sizeof(policy_names) / sizeof(policy_names[0]); i++) {
+    if (strcmp(name, policy_names[i])) continue;
+
+    *policy = (PrefetchPolicy) i;
+    return true;
+  }
+
+  return false;
+}
+
+const char* prefetch_policy_name(const PrefetchPolicy policy) {
+  return policy_names[policy];
+}
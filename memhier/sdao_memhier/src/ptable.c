@@ -2,10 +2,12 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "util.h"
 #include "ptable.h"
 #include "set.h"
+#include "snapshot.h"
 #include "tlb.h"
 #include "cache.h"
 
@@ -13,16 +15,25 @@ typedef struct TableEntry TableEntry;
 typedef struct PTable PTable;
 typedef struct PTableStats PTableStats;
 
+static const char* type_names[] = {
+  [PTABLE_FLAT] = "flat",
+  [PTABLE_RADIX] = "radix",
+  [PTABLE_HASHED] = "hashed",
+};
+
 struct TableEntry {
   size_t page;
   bool dirty;
   bool valid;
+  bool referenced;    // CLOCK/second chance reference bit, set on every access
 };
 
 struct PTable {
   size_t vpages;
   size_t ppages;
   size_t page_size;
+  PageTableType type;
+  PageReplacementPolicy replacement;
   
   size_t offset_bits;
   uint32_t page_offset_mask;
@@ -30,35 +41,111 @@ struct PTable {
   PTableStats* stats;
 
   // Page Table
-  TableEntry* vpage_table;
+  TableEntry* vpage_table;      // flat table
+
+  // radix tree, inner nodes are arrays of child pointers and the leaves are arrays of entries.
+  // level 0 is the root and indexes the highest virtual page bits.
+  void** radix_root;
+  size_t radix_bits[PTABLE_RADIX_LEVELS];
+  size_t radix_shift[PTABLE_RADIX_LEVELS];
+
+  // hashed table, anchors hold the first frame (plus one) of each chain and frame_next links the frames
+  uint32_t* anchors;
+  uint32_t* frame_next;
+  size_t anchor_bits;
 
   // Inverse Table
-  Set* ppage_set;
+  Set* ppage_set;           // LRU order of the frames, only kept for LRU
   TableEntry* ppage_table;
   size_t cur_ppage;
 
+  // Free frames, bit set when the frame holds a page. bits past the last frame are always set.
+  uint64_t* used_frames;
+  size_t free_frames;
+
+  // CLOCK/second chance hand, the next frame to consider
+  size_t hand;
+
+  // latency model, `cycles` is the running cost of the current reference (NULL when not timed)
+  uint64_t* cycles;
+  size_t walk_latency;
+  size_t disk_latency;
+
+  // per page fault counters, an open addressing table by virtual page kept at most half full.
+  // allocated up front but only counted while `instrumented`
+  bool instrumented;
+  PageFaults* faults;
+  size_t faults_mask;       // entries - 1
+  size_t faults_capacity;   // pages that can be tracked
+  size_t faults_used;
+  uint64_t faults_untracked;
+
   TLB* tlb;
   Cache* cache;
 };
 
-PTable* ptable_new(const size_t vpages, const size_t ppages, const size_t page_size) { 
-  PTable* ptable = malloc(sizeof(PTable));
+PTable* ptable_new(const size_t vpages, const size_t ppages, const size_t page_size, const PageTableType type, const size_t address_bits, const PageReplacementPolicy replacement) { 
+  PTable* ptable = calloc(1, sizeof(PTable));
   ptable->vpages = vpages;
   ptable->ppages = ppages;
   ptable->page_size = page_size;
+  ptable->type = type;
+  ptable->replacement = replacement;
   ptable->offset_bits = log_2(page_size);
   ptable->page_offset_mask = ~(~0u << ptable->offset_bits);
-  ptable->stats = malloc(sizeof(PTableStats));
-  ptable->ppage_set = Set_new(ppages);
+  ptable->stats = calloc(1, sizeof(PTableStats));
   ptable->ppage_table = calloc(ppages + 1, sizeof(TableEntry));
-  ptable->vpage_table = calloc(vpages, sizeof(TableEntry));
+
+  switch (type) {
+    case PTABLE_FLAT:
+      ptable->vpage_table = calloc(vpages, sizeof(TableEntry));
+      ptable->stats->table_bytes = vpages * sizeof(TableEntry);
+      break;
+    case PTABLE_RADIX: {
+      // split the virtual page bits over the levels, the upper levels take any leftover bits
+      size_t page_bits = address_bits - ptable->offset_bits;
+      size_t shift = page_bits;
+      for (size_t i = 0; i < PTABLE_RADIX_LEVELS; i++) {
+        ptable->radix_bits[i] = page_bits / PTABLE_RADIX_LEVELS + (i < page_bits % PTABLE_RADIX_LEVELS);
+        shift -= ptable->radix_bits[i];
+        ptable->radix_shift[i] = shift;
+      }
+
+      ptable->radix_root = calloc(1ul << ptable->radix_bits[0], sizeof(void*));
+      ptable->stats->table_bytes = (1ul << ptable->radix_bits[0]) * sizeof(void*);
+      break;
+    }
+    case PTABLE_HASHED:
+      // about one chain per frame
+      ptable->anchor_bits = log_2(ppages);
+      ptable->anchors = calloc(1ul << ptable->anchor_bits, sizeof(uint32_t));
+      ptable->frame_next = calloc(ppages, sizeof(uint32_t));
+      ptable->stats->table_bytes = ((1ul << ptable->anchor_bits) + ppages) * sizeof(uint32_t);
+      break;
+  }
+
+  size_t words = (ppages + 63) / 64;
+  ptable->used_frames = calloc(words, sizeof(uint64_t));
+  ptable->free_frames = ppages;
+  if (ppages % 64)
+    ptable->used_frames[words - 1] = ~0ull << (ppages % 64);
   
   // Connect the ptable_set and ptable_table
-  SetNode* node_list = ptable->ppage_set->node_list;
-  for (size_t i = 0; i < ppages + 1; i++) {
-    node_list[i].data = ptable->ppage_table + i;
+  if (replacement == PAGE_LRU) {
+    ptable->ppage_set = Set_new(ppages);
+    SetNode* node_list = ptable->ppage_set->node_list;
+    for (size_t i = 0; i < ppages + 1; i++) {
+      node_list[i].data = ptable->ppage_table + i;
+    }
   }
   
+  // a flat table can only fault on its own pages, the others on as many as their frames see come and go
+  ptable->faults_capacity = type == PTABLE_FLAT ? vpages : ppages * PTABLE_FAULT_PAGES_PER_FRAME;
+  size_t entries = 2;
+  while (entries < ptable->faults_capacity * 2) entries *= 2;
+  ptable->faults_mask = entries - 1;
+  ptable->faults = calloc(entries, sizeof(PageFaults));
+
   // ppage_table should start one after sentinel
   ptable->ppage_table += 1;
 
@@ -75,71 +162,260 @@ void ptable_connect_cache(PTable* ptable, Cache* cache) {
   ptable->cache = cache;
 }
 
+// frees a radix node and everything below it
+static void _ptable_radix_free(void** node, const size_t level, const size_t* bits) {
+  if (!node) return;
+
+  if (level + 1 < PTABLE_RADIX_LEVELS - 1) {
+    for (size_t i = 0; i < (1ul << bits[level]); i++)
+      _ptable_radix_free(node[i], level + 1, bits);
+  } else {
+    for (size_t i = 0; i < (1ul << bits[level]); i++)
+      free(node[i]);
+  }
+
+  free(node);
+}
+
 void ptable_free(PTable* ptable) {
   free(ptable->stats); 
   free(ptable->vpage_table);
+  _ptable_radix_free(ptable->radix_root, 0, ptable->radix_bits);
+  free(ptable->anchors);
+  free(ptable->frame_next);
   free(ptable->ppage_table - 1);
-  Set_free(ptable->ppage_set);
+  free(ptable->used_frames);
+  if (ptable->ppage_set) Set_free(ptable->ppage_set);
+  free(ptable->faults);
   free(ptable);
 }
 
-void _ptable_update(PTable* ptable, uint32_t vpage, uint32_t ppage) {
-  TableEntry* p_entry = ptable->ppage_table + ptable->cur_ppage;
-  TableEntry* v_entry = ptable->vpage_table + vpage;
+// marks an access to the frame for the replacement policy
+static inline void _ptable_touch(PTable* ptable, const uint32_t ppage) {
+  if (ptable->ppage_set)
+    Set_set_mru(ptable->ppage_set, ptable->ppage_set->node_list + 1 + ppage);
+  else
+    ptable->ppage_table[ppage].referenced = true;
+}
 
-  v_entry->valid = p_entry->valid = true;
+// returns the radix leaf entry of `vpage`, allocating the path to it when `create` is set.
+// returns NULL when part of the path doesn't exist and `create` isn't set.
+static TableEntry* _ptable_radix_entry(PTable* ptable, const uint64_t vpage, const bool create) {
+  void** node = ptable->radix_root;
 
-  v_entry->page = ppage;
+  for (size_t level = 0; level < PTABLE_RADIX_LEVELS - 1; level++) {
+    size_t i = (vpage >> ptable->radix_shift[level]) & ~(~0ul << ptable->radix_bits[level]);
+    if (!node[i]) {
+      if (!create) return NULL;
+
+      // the last inner level points at leaves of entries
+      size_t count = 1ul << ptable->radix_bits[level + 1];
+      size_t size = level + 1 == PTABLE_RADIX_LEVELS - 1 ? sizeof(TableEntry) : sizeof(void*);
+      node[i] = calloc(count, size);
+      ptable->stats->table_bytes += count * size;
+    }
+
+    node = node[i];
+  }
+
+  return (TableEntry*) node + (vpage & ~(~0ul << ptable->radix_bits[PTABLE_RADIX_LEVELS - 1]));
+}
+
+static inline size_t _ptable_hash(const PTable* ptable, const uint64_t vpage) {
+  return ptable->anchor_bits ? (vpage * 0x9e3779b97f4a7c15ull) >> (64 - ptable->anchor_bits) : 0;
+}
+
+// looks up the frame holding `vpage`
+static bool _ptable_lookup(PTable* ptable, const uint64_t vpage, uint32_t* ppage) {
+  const TableEntry* v_entry;
+
+  switch (ptable->type) {
+    case PTABLE_RADIX:
+      v_entry = _ptable_radix_entry(ptable, vpage, false);
+      break;
+    case PTABLE_HASHED:
+      for (uint32_t frame = ptable->anchors[_ptable_hash(ptable, vpage)]; frame; frame = ptable->frame_next[frame - 1]) {
+        if (ptable->ppage_table[frame - 1].page != vpage) continue;
+
+        *ppage = frame - 1;
+        return true;
+      }
+      return false;
+    default:
+      v_entry = ptable->vpage_table + vpage;
+      break;
+  }
+
+  if (!v_entry || !v_entry->valid) return false;
+
+  *ppage = v_entry->page;
+  return true;
+}
+
+// records that `vpage` is now held by `ppage`
+static void _ptable_map(PTable* ptable, const uint64_t vpage, const uint32_t ppage) {
+  TableEntry* p_entry = ptable->ppage_table + ppage;
+  TableEntry* v_entry;
+
+  p_entry->valid = true;
   p_entry->page = vpage;
-  
-  Set_set_mru(ptable->ppage_set, ptable->ppage_set->node_list + 1 + ppage);
+
+  switch (ptable->type) {
+    case PTABLE_RADIX:
+      v_entry = _ptable_radix_entry(ptable, vpage, true);
+      break;
+    case PTABLE_HASHED: {
+      uint32_t* anchor = ptable->anchors + _ptable_hash(ptable, vpage);
+      ptable->frame_next[ppage] = *anchor;
+      *anchor = ppage + 1;
+      return;
+    }
+    default:
+      v_entry = ptable->vpage_table + vpage;
+      break;
+  }
+
+  v_entry->valid = true;
+  v_entry->page = ppage;
+}
+
+// forgets the page held by `ppage`
+static void _ptable_unmap(PTable* ptable, const uint32_t ppage) {
+  const uint64_t vpage = ptable->ppage_table[ppage].page;
+
+  switch (ptable->type) {
+    case PTABLE_RADIX:
+      _ptable_radix_entry(ptable, vpage, false)->valid = false;
+      break;
+    case PTABLE_HASHED: {
+      uint32_t* link = ptable->anchors + _ptable_hash(ptable, vpage);
+      while (*link != ppage + 1)
+        link = ptable->frame_next + *link - 1;
+      *link = ptable->frame_next[ppage];
+      break;
+    }
+    default:
+      ptable->vpage_table[vpage].valid = false;
+      break;
+  }
+}
+
+// finds the first free frame at or after cur_ppage (wrapping around) and marks it used.
+// frames are never freed, so once the table fills up this returns false right away.
+bool _ptable_alloc_frame(PTable* ptable, uint32_t* ppage) {
+  if (!ptable->free_frames) return false;
+
+  size_t words = (ptable->ppages + 63) / 64;
+  size_t word = ptable->cur_ppage / 64;
+  uint64_t used = ptable->used_frames[word] | ~(~0ull << (ptable->cur_ppage % 64));
+
+  // the first word is visited again at the end for the frames before cur_ppage
+  for (size_t i = 0; i <= words; i++) {
+    if (~used) {
+      *ppage = word * 64 + __builtin_ctzll(~used);
+      ptable->used_frames[word] |= 1ull << (*ppage % 64);
+      ptable->free_frames -= 1;
+      return true;
+    }
+
+    word = (word + 1) % words;
+    used = ptable->used_frames[word];
+  }
+
+  return false;
+}
+
+// CLOCK: the first frame under the hand that wasn't referenced since the hand last passed it
+static uint32_t _ptable_victim_clock(PTable* ptable) {
+  while (ptable->ppage_table[ptable->hand].referenced) {
+    ptable->ppage_table[ptable->hand].referenced = false;
+    ptable->hand = (ptable->hand + 1) % ptable->ppages;
+  }
+
+  return ptable->hand;
+}
+
+// enhanced second chance: looks for an unreferenced clean frame, then an unreferenced dirty frame
+// clearing reference bits along the way, and repeats once more if every frame was referenced
+static uint32_t _ptable_victim_second_chance(PTable* ptable) {
+  for (size_t round = 0; round < 4; round++) {
+    bool want_dirty = round % 2;
+
+    for (size_t i = 0; i < ptable->ppages; i++, ptable->hand = (ptable->hand + 1) % ptable->ppages) {
+      TableEntry* p_entry = ptable->ppage_table + ptable->hand;
+      if (!p_entry->referenced && p_entry->dirty == want_dirty)
+        return ptable->hand;
+
+      if (want_dirty) p_entry->referenced = false;
+    }
+  }
+
+  // unreachable, the last round looks at every frame with its reference bit cleared
+  return ptable->hand;
+}
+
+static void _ptable_disk_access(PTable* ptable) {
+  ptable->stats->disk_accesses += 1;
+  if (ptable->cycles) *ptable->cycles += ptable->disk_latency;
 }
 
 uint32_t _ptable_evict(PTable* ptable) {
-  SetNode* lru = Set_get_lru(ptable->ppage_set);
-  TableEntry* p_entry = (TableEntry*) lru->data;
-  uint32_t ppage = p_entry - ptable->ppage_table;
+  uint32_t ppage;
+
+  switch (ptable->replacement) {
+    case PAGE_CLOCK:
+      ppage = _ptable_victim_clock(ptable);
+      break;
+    case PAGE_SECOND_CHANCE:
+      ppage = _ptable_victim_second_chance(ptable);
+      break;
+    default:
+      ppage = (TableEntry*) Set_get_lru(ptable->ppage_set)->data - ptable->ppage_table;
+      break;
+  }
+
+  TableEntry* p_entry = ptable->ppage_table + ppage;
   
   if (!p_entry->valid)
-    fprintf(stderr, "The evictor was called but LRU was already invalid?");
+    fprintf(stderr, "The evictor was called but the victim was already invalid?");
   
+  // the victim is written back, whatever is loaded into the frame starts clean
   if (p_entry->dirty) {
-    ptable->stats->disk_accesses += 1;
+    _ptable_disk_access(ptable);
+    p_entry->dirty = false;
   }
-  ptable->vpage_table[p_entry->page].valid = false;
+  _ptable_unmap(ptable, ppage);
+
+  // the hand moves past the frame that was just loaded
+  ptable->hand = (ppage + 1) % ptable->ppages;
 
   return ppage;
 } 
 
-bool _ptable_get(PTable* ptable, uint32_t vpage, uint32_t* ppage, bool write) {
-  TableEntry* v_entry = ptable->vpage_table + vpage;
+bool _ptable_get(PTable* ptable, uint64_t vpage, uint32_t* ppage, bool write) {
   bool hit = false;
 
     // hit, return entry
-  if (v_entry->valid) {
+  if (_ptable_lookup(ptable, vpage, ppage)) {
     hit = true;
-    *ppage = v_entry->page;  
     goto L_update_ptable;
   }
   
   // disk_access for page read
-  ptable->stats->disk_accesses += 1;
+  _ptable_disk_access(ptable);
 
-  // search for free physical page
-  for (size_t i = 0; i < ptable->ppages; ptable->cur_ppage = (ptable->cur_ppage + 1) % ptable->ppages, i++) {
-    TableEntry* p_entry = ptable->ppage_table + ptable->cur_ppage;
-    if (p_entry->valid) continue;
-    
-    *ppage = ptable->cur_ppage; 
-    goto L_update_ptable;
-  }
+  // take a free physical page, otherwise evict and reassign a page
+  if (_ptable_alloc_frame(ptable, ppage)) {
+    ptable->cur_ppage = *ppage;
+  } else {
+    *ppage = ptable->cur_ppage = _ptable_evict(ptable);
+    if (ptable->tlb) TLB_invalidate_ppage(ptable->tlb, *ppage);
 
-  // evict and reassign a page
-  *ppage = ptable->cur_ppage = _ptable_evict(ptable);
-  if (ptable->tlb) TLB_invalidate_ppage(ptable->tlb, *ppage);
+    uint32_t low_addr = *ppage * ptable->page_size;
+    if (ptable->cache) cache_invalidate_range(ptable->cache, low_addr, low_addr + ptable->page_size - 1);
+  }
 
-  uint32_t low_addr = *ppage * ptable->page_size;
-  if (ptable->cache) cache_invalidate_range(ptable->cache, low_addr, low_addr + ptable->page_size - 1);
+  _ptable_map(ptable, vpage, *ppage);
 
 L_update_ptable:
 
@@ -147,17 +423,247 @@ L_update_ptable:
     ptable->ppage_table[*ppage].dirty = true;
   }
 
-  _ptable_update(ptable, vpage, *ppage); 
-  Set_set_mru(ptable->ppage_set, ptable->ppage_set->node_list + 1 + *ppage);
+  _ptable_touch(ptable, *ppage);
 
   return hit;
 }
 
+// SNAPSHOTS
+
+// a byte per child tells whether it exists, each existing child follows right after its byte
+static bool _ptable_radix_save(void** node, const size_t level, const size_t* bits, FILE* f) {
+  const bool leaves = level + 1 == PTABLE_RADIX_LEVELS - 1;
+
+  for (size_t i = 0; i < (1ul << bits[level]); i++) {
+    uint8_t present = node[i] != NULL;
+    if (!snapshot_write(f, &present, 1)) return false;
+    if (!present) continue;
+
+    if (leaves ? !snapshot_write(f, node[i], sizeof(TableEntry) << bits[level + 1]) : !_ptable_radix_save(node[i], level + 1, bits, f))
+      return false;
+  }
+
+  return true;
+}
+
+// a loaded entry has to hold bools that are 0 or 1 and, when valid, a page below `pages`
+static bool _ptable_entry_ok(const TableEntry* entry, const uint64_t pages) {
+  uint8_t dirty, valid, referenced;
+  memcpy(&dirty, &entry->dirty, 1);
+  memcpy(&valid, &entry->valid, 1);
+  memcpy(&referenced, &entry->referenced, 1);
+
+  return dirty <= 1 && valid <= 1 && referenced <= 1 && (!valid || entry->page < pages);
+}
+
+// counts the valid entries of the leaves in `mapped`, they have to hold frames below `ppages`
+static bool _ptable_radix_load(void** node, const size_t level, const size_t* bits, const size_t ppages, size_t* mapped, FILE* f) {
+  const bool leaves = level + 1 == PTABLE_RADIX_LEVELS - 1;
+
+  for (size_t i = 0; i < (1ul << bits[level]); i++) {
+    uint8_t present;
+    if (!snapshot_read(f, &present, 1) || present > 1) return false;
+    if (!present) continue;
+
+    size_t count = 1ul << bits[level + 1];
+    if (!node[i]) node[i] = calloc(count, leaves ? sizeof(TableEntry) : sizeof(void*));
+    if (!leaves) {
+      if (!_ptable_radix_load(node[i], level + 1, bits, ppages, mapped, f)) return false;
+      continue;
+    }
+
+    if (!snapshot_read(f, node[i], sizeof(TableEntry) * count)) return false;
+    for (size_t j = 0; j < count; j++) {
+      const TableEntry* entry = (const TableEntry*) node[i] + j;
+      if (!_ptable_entry_ok(entry, ppages)) return false;
+      *mapped += entry->valid;
+    }
+  }
+
+  return true;
+}
+
+bool ptable_save(const PTable* ptable, FILE* f) {
+  size_t words = (ptable->ppages + 63) / 64;
+
+  if (!snapshot_write(f, ptable->stats, sizeof(PTableStats))
+      || !snapshot_write(f, ptable->ppage_table, sizeof(TableEntry) * ptable->ppages)
+      || !snapshot_write(f, ptable->used_frames, sizeof(uint64_t) * words)
+      || !snapshot_write(f, &ptable->free_frames, sizeof(ptable->free_frames))
+      || !snapshot_write(f, &ptable->cur_ppage, sizeof(ptable->cur_ppage))
+      || !snapshot_write(f, &ptable->hand, sizeof(ptable->hand)))
+    return false;
+
+  if (ptable->instrumented && (!snapshot_write(f, ptable->faults, sizeof(PageFaults) * (ptable->faults_mask + 1))
+      || !snapshot_write(f, &ptable->faults_used, sizeof(ptable->faults_used))
+      || !snapshot_write(f, &ptable->faults_untracked, sizeof(ptable->faults_untracked))))
+    return false;
+
+  switch (ptable->type) {
+    case PTABLE_RADIX:
+      if (!_ptable_radix_save(ptable->radix_root, 0, ptable->radix_bits, f)) return false;
+      break;
+    case PTABLE_HASHED:
+      if (!snapshot_write(f, ptable->anchors, sizeof(uint32_t) << ptable->anchor_bits)
+          || !snapshot_write(f, ptable->frame_next, sizeof(uint32_t) * ptable->ppages))
+        return false;
+      break;
+    default:
+      if (!snapshot_write(f, ptable->vpage_table, sizeof(TableEntry) * ptable->vpages)) return false;
+      break;
+  }
+
+  // the LRU order as frame numbers from the LRU to the MRU
+  if (!ptable->ppage_set) return true;
+
+  SetNode* cur;
+  SET_TRAVERSE_LEFT(cur, ptable->ppage_set->node_list) {
+    uint32_t ppage = (TableEntry*) cur->data - ptable->ppage_table;
+    if (!snapshot_write(f, &ppage, sizeof(ppage))) return false;
+  }
+
+  return true;
+}
+
+// a loaded table has to be one ptable_save could have written. the frame scans index the bitmap with cur_ppage
+// and hand, and the frames and the table have to describe the same `mapped` pages: every page a frame holds
+// leads back to it and the table holds no others
+static bool _ptable_frames_ok(PTable* ptable, const size_t mapped) {
+  if (ptable->hand >= ptable->ppages || ptable->cur_ppage >= ptable->ppages || ptable->free_frames > ptable->ppages)
+    return false;
+
+  // bits past the last frame are set too
+  size_t words = (ptable->ppages + 63) / 64;
+  size_t used = 0;
+  for (size_t i = 0; i < words; i++)
+    used += __builtin_popcountll(ptable->used_frames[i]);
+  if (used != words * 64 - ptable->free_frames) return false;
+
+  size_t valid = 0;
+  for (uint32_t ppage = 0; ppage < ptable->ppages; ppage++) {
+    const TableEntry* entry = ptable->ppage_table + ppage;
+    uint32_t frame;
+
+    if (!_ptable_entry_ok(entry, ptable->type == PTABLE_FLAT ? ptable->vpages : UINT64_MAX)) return false;
+    if (!entry->valid) continue;
+    if (!_ptable_lookup(ptable, entry->page, &frame) || frame != ppage) return false;
+    valid += 1;
+  }
+
+  return valid == mapped;
+}
+
+bool ptable_load(PTable* ptable, FILE* f) {
+  size_t words = (ptable->ppages + 63) / 64;
+  size_t mapped = 0;
+
+  if (!snapshot_read(f, ptable->stats, sizeof(PTableStats))
+      || !snapshot_read(f, ptable->ppage_table, sizeof(TableEntry) * ptable->ppages)
+      || !snapshot_read(f, ptable->used_frames, sizeof(uint64_t) * words)
+      || !snapshot_read(f, &ptable->free_frames, sizeof(ptable->free_frames))
+      || !snapshot_read(f, &ptable->cur_ppage, sizeof(ptable->cur_ppage))
+      || !snapshot_read(f, &ptable->hand, sizeof(ptable->hand)))
+    return false;
+
+  if (ptable->instrumented && (!snapshot_read(f, ptable->faults, sizeof(PageFaults) * (ptable->faults_mask + 1))
+      || !snapshot_read(f, &ptable->faults_used, sizeof(ptable->faults_used))
+      || !snapshot_read(f, &ptable->faults_untracked, sizeof(ptable->faults_untracked))
+      || ptable->faults_used > ptable->faults_capacity))
+    return false;
+
+  switch (ptable->type) {
+    case PTABLE_RADIX:
+      if (!_ptable_radix_load(ptable->radix_root, 0, ptable->radix_bits, ptable->ppages, &mapped, f)) return false;
+      break;
+    case PTABLE_HASHED:
+      if (!snapshot_read(f, ptable->anchors, sizeof(uint32_t) << ptable->anchor_bits)
+          || !snapshot_read(f, ptable->frame_next, sizeof(uint32_t) * ptable->ppages))
+        return false;
+
+      // every chain has to end, so all of them together can't link more frames than there are
+      for (size_t i = 0; i < (1ul << ptable->anchor_bits); i++) {
+        for (uint32_t frame = ptable->anchors[i]; frame; frame = ptable->frame_next[frame - 1])
+          if (frame > ptable->ppages || ++mapped > ptable->ppages) return false;
+      }
+      break;
+    default:
+      if (!snapshot_read(f, ptable->vpage_table, sizeof(TableEntry) * ptable->vpages)) return false;
+
+      for (size_t i = 0; i < ptable->vpages; i++) {
+        if (!_ptable_entry_ok(ptable->vpage_table + i, ptable->ppages)) return false;
+        mapped += ptable->vpage_table[i].valid;
+      }
+      break;
+  }
+
+  if (!_ptable_frames_ok(ptable, mapped)) return false;
+  if (!ptable->ppage_set) return true;
+
+  // making each frame the MRU in turn leaves them in the saved order
+  for (size_t i = 0; i < ptable->ppages; i++) {
+    uint32_t ppage;
+    if (!snapshot_read(f, &ppage, sizeof(ppage)) || ppage >= ptable->ppages) return false;
+    Set_set_mru(ptable->ppage_set, ptable->ppage_set->node_list + 1 + ppage);
+  }
+
+  return true;
+}
+
+void ptable_reset_stats(PTable* ptable) {
+  ptable->stats->hits = 0;
+  ptable->stats->total_accesses = 0;
+  ptable->stats->disk_accesses = 0;
+
+  memset(ptable->faults, 0, sizeof(PageFaults) * (ptable->faults_mask + 1));
+  ptable->faults_used = 0;
+  ptable->faults_untracked = 0;
+}
+
+void ptable_set_instrument(PTable* ptable, const bool instrument) {
+  ptable->instrumented = instrument;
+}
+
+const PageFaults* ptable_page_faults(const PTable* ptable, size_t* size, uint64_t* untracked) {
+  *size = ptable->faults_mask + 1;
+  *untracked = ptable->faults_untracked;
+  return ptable->faults;
+}
+
+// counts a fault on `vpage`
+static void _ptable_count_fault(PTable* ptable, const uint64_t vpage) {
+  size_t i = (size_t)((vpage * 0x9E3779B97F4A7C15ull) >> 32) & ptable->faults_mask;
+
+  while (ptable->faults[i].faults && ptable->faults[i].vpage != vpage)
+    i = (i + 1) & ptable->faults_mask;
+
+  if (!ptable->faults[i].faults) {
+    if (ptable->faults_used == ptable->faults_capacity) {
+      ptable->faults_untracked += 1;
+      return;
+    }
+    ptable->faults_used += 1;
+    ptable->faults[i].vpage = vpage;
+  }
+
+  ptable->faults[i].faults += 1;
+}
+
 PTableStats* ptable_stats(const PTable* ptable) {
   return ptable->stats;
 }
 
-uint32_t ptable_virt_phys(PTable* ptable, const uint32_t v_addr, bool write) {
+size_t ptable_num_ppages(const PTable* ptable) {
+  return ptable->ppages;
+}
+
+void ptable_set_timing(PTable* ptable, uint64_t* cycles, const size_t walk_latency, const size_t disk_latency) {
+  ptable->cycles = cycles;
+  ptable->walk_latency = walk_latency;
+  ptable->disk_latency = disk_latency;
+}
+
+uint32_t ptable_virt_phys(PTable* ptable, const uint64_t v_addr, bool write) {
+  if (ptable->cycles) *ptable->cycles += ptable->walk_latency;
   ptable->stats->total_accesses += 1;
   ptable->stats->offset = v_addr & ptable->page_offset_mask;
 
@@ -165,6 +671,23 @@ uint32_t ptable_virt_phys(PTable* ptable, const uint32_t v_addr, bool write) {
   ptable->stats->hit = _ptable_get(ptable, ptable->stats->vpage, &ptable->stats->ppage, write);
   if (ptable->stats->hit)
     ptable->stats->hits += 1;
+  else if (ptable->instrumented)
+    _ptable_count_fault(ptable, ptable->stats->vpage);
   
   return (ptable->stats->ppage << ptable->offset_bits) | ptable->stats->offset;  
 }
+
+bool page_table_type_parse(const char* name, PageTableType* type) {
+  for (size_t i = 0; i < sizeof(type_names) / sizeof(type_names[0]); i++) {
+    if (strcmp(name, type_names[i])) continue;
+
+    *type = (PageTableType) i;
+    return true;
+  }
+
+  return false;
+}
+
+const char* page_table_type_name(const PageTableType type) {
+  return type_names[type];
+}
@@ -0,0 +1,258 @@
+#include <stdlib.h>
+#include <string.h>
+#include "replace.h"
+#include "set.h"
+#include "snapshot.h"
+#include "util.h"
+
+#define RRPV_BITS       2u
+#define RRPV_MAX        3u
+#define RRPV_LONG       2u
+#define RRPV_MASK       0x5555555555555555ull    // low bit of every RRPV field
+
+// BRRIP predicts a long re-reference interval instead of a distant one once every 32 fills
+#define BRRIP_LONG_ODDS 32u
+
+static const char* policy_names[] = {
+  [REPLACE_LRU] = "lru",
+  [REPLACE_PLRU] = "plru",
+  [REPLACE_SRRIP] = "srrip",
+  [REPLACE_BRRIP] = "brrip",
+  [REPLACE_FIFO] = "fifo",
+  [REPLACE_RANDOM] = "random",
+};
+
+static const char* page_policy_names[] = {
+  [PAGE_LRU] = "lru",
+  [PAGE_CLOCK] = "clock",
+  [PAGE_SECOND_CHANCE] = "second-chance",
+};
+
+Replacer* replacer_new(const ReplacementPolicy policy, const size_t num_sets, const size_t set_size) {
+  Replacer* replacer = calloc(1, sizeof(Replacer));
+  replacer->policy = policy;
+  replacer->num_sets = num_sets;
+  replacer->set_size = set_size;
+  replacer->levels = log_2(set_size);
+
+  switch (policy) {
+    case REPLACE_LRU:
+    case REPLACE_FIFO:
+      replacer->ranks = malloc(sizeof(uint8_t) * num_sets * set_size);
+      break;
+    case REPLACE_PLRU:
+      replacer->plru = malloc(sizeof(uint32_t) * num_sets);
+      break;
+    case REPLACE_SRRIP:
+    case REPLACE_BRRIP:
+      replacer->rrpv = malloc(sizeof(uint64_t) * num_sets);
+      break;
+    case REPLACE_RANDOM:
+      break;
+  }
+
+  replacer_reset(replacer);
+  return replacer;
+}
+
+void replacer_free(Replacer* replacer) {
+  free(replacer->ranks);
+  free(replacer->plru);
+  free(replacer->rrpv);
+  free(replacer);
+}
+
+// forgets all history. LRU/FIFO go back to way 0 as the most recent and the last way as the least.
+void replacer_reset(Replacer* replacer) {
+  replacer->seed = 0x9e3779b9u;
+
+  if (replacer->ranks) {
+    for (size_t i = 0; i < replacer->num_sets; i++)
+      Set_ranks_init(replacer->ranks + i * replacer->set_size, replacer->set_size);
+  }
+  if (replacer->plru)
+    memset(replacer->plru, 0, sizeof(uint32_t) * replacer->num_sets);
+  if (replacer->rrpv)
+    memset(replacer->rrpv, 0xff, sizeof(uint64_t) * replacer->num_sets);
+}
+
+bool replacer_save(const Replacer* replacer, FILE* f) {
+  const size_t sets = replacer->num_sets;
+
+  return snapshot_write(f, &replacer->seed, sizeof(replacer->seed))
+    && (!replacer->ranks || snapshot_write(f, replacer->ranks, sizeof(uint8_t) * sets * replacer->set_size))
+    && (!replacer->plru || snapshot_write(f, replacer->plru, sizeof(uint32_t) * sets))
+    && (!replacer->rrpv || snapshot_write(f, replacer->rrpv, sizeof(uint64_t) * sets));
+}
+
+bool replacer_load(Replacer* replacer, FILE* f) {
+  const size_t sets = replacer->num_sets;
+
+  return snapshot_read(f, &replacer->seed, sizeof(replacer->seed))
+    && (!replacer->ranks || snapshot_read(f, replacer->ranks, sizeof(uint8_t) * sets * replacer->set_size))
+    && (!replacer->plru || snapshot_read(f, replacer->plru, sizeof(uint32_t) * sets))
+    && (!replacer->rrpv || snapshot_read(f, replacer->rrpv, sizeof(uint64_t) * sets));
+}
+
+// xorshift32
+static inline uint32_t _replacer_random(Replacer* replacer) {
+  uint32_t x = replacer->seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return replacer->seed = x;
+}
+
+static inline void _replacer_set_rrpv(Replacer* replacer, const size_t set, const size_t way, const uint64_t rrpv) {
+  uint64_t shift = way * RRPV_BITS;
+  replacer->rrpv[set] = (replacer->rrpv[set] & ~((uint64_t) RRPV_MAX << shift)) | (rrpv << shift);
+}
+
+// points every tree node on the path to `way` away from it
+static inline void _replacer_plru_touch(Replacer* replacer, const size_t set, const size_t way) {
+  uint32_t tree = replacer->plru[set];
+  size_t node = 1;
+
+  for (size_t level = replacer->levels; level > 0; level--) {
+    uint32_t right = (way >> (level - 1)) & 1u;
+    if (right)
+      tree &= ~(1u << (node - 1));
+    else
+      tree |= 1u << (node - 1);
+    node = node * 2 + right;
+  }
+
+  replacer->plru[set] = tree;
+}
+
+// called on a hit
+void replacer_touch(Replacer* replacer, const size_t set, const size_t way) {
+  switch (replacer->policy) {
+    case REPLACE_LRU:
+      Set_ranks_set_mru(replacer->ranks + set * replacer->set_size, replacer->set_size, way);
+      break;
+    case REPLACE_PLRU:
+      _replacer_plru_touch(replacer, set, way);
+      break;
+    case REPLACE_SRRIP:
+    case REPLACE_BRRIP:
+      _replacer_set_rrpv(replacer, set, way, 0);
+      break;
+    case REPLACE_FIFO:
+    case REPLACE_RANDOM:
+      break;
+  }
+}
+
+// called when a new line is placed in `way`
+void replacer_fill(Replacer* replacer, const size_t set, const size_t way) {
+  switch (replacer->policy) {
+    case REPLACE_LRU:
+    case REPLACE_FIFO:
+      Set_ranks_set_mru(replacer->ranks + set * replacer->set_size, replacer->set_size, way);
+      break;
+    case REPLACE_PLRU:
+      _replacer_plru_touch(replacer, set, way);
+      break;
+    case REPLACE_SRRIP:
+      _replacer_set_rrpv(replacer, set, way, RRPV_LONG);
+      break;
+    case REPLACE_BRRIP:
+      _replacer_set_rrpv(replacer, set, way, _replacer_random(replacer) % BRRIP_LONG_ODDS ? RRPV_MAX : RRPV_LONG);
+      break;
+    case REPLACE_RANDOM:
+      break;
+  }
+}
+
+// picks the way to evict from a full set
+size_t replacer_victim(Replacer* replacer, const size_t set) {
+  switch (replacer->policy) {
+    case REPLACE_LRU:
+    case REPLACE_FIFO:
+      return Set_ranks_get_lru(replacer->ranks + set * replacer->set_size, replacer->set_size);
+
+    case REPLACE_PLRU: {
+      uint32_t tree = replacer->plru[set];
+      size_t node = 1, way = 0;
+
+      for (size_t level = 0; level < replacer->levels; level++) {
+        uint32_t right = (tree >> (node - 1)) & 1u;
+        way = (way << 1) | right;
+        node = node * 2 + right;
+      }
+      return way;
+    }
+
+    case REPLACE_SRRIP:
+    case REPLACE_BRRIP: {
+      uint64_t rrpv = replacer->rrpv[set];
+      uint64_t max = 0;
+
+      for (size_t way = 0; way < replacer->set_size; way++) {
+        uint64_t v = (rrpv >> (way * RRPV_BITS)) & RRPV_MAX;
+        if (v > max) max = v;
+      }
+
+      // age every way at once until the oldest reaches RRPV_MAX
+      uint64_t used = replacer->set_size * RRPV_BITS == 64 ? ~0ull : ~(~0ull << (replacer->set_size * RRPV_BITS));
+      rrpv += (RRPV_MASK & used) * (RRPV_MAX - max);
+      replacer->rrpv[set] = rrpv;
+
+      for (size_t way = 0; way < replacer->set_size; way++) {
+        if (((rrpv >> (way * RRPV_BITS)) & RRPV_MAX) == RRPV_MAX) return way;
+      }
+      return 0;
+    }
+
+    case REPLACE_RANDOM:
+      return _replacer_random(replacer) & (replacer->set_size - 1);
+  }
+
+  return 0;
+}
+
+// picks an invalid way to fill, returns false when every way is valid.
+// LRU and FIFO take the least recent invalid way, the rest take the lowest one.
+bool replacer_find_invalid(const Replacer* replacer, const size_t set, const uint32_t valid, size_t* way) {
+  if (replacer->ranks) {
+    *way = Set_ranks_get_lru_clear(replacer->ranks + set * replacer->set_size, replacer->set_size, valid);
+    return *way != replacer->set_size;
+  }
+
+  uint32_t invalid = ~valid & (replacer->set_size == 32 ? ~0u : ~(~0u << replacer->set_size));
+  if (!invalid) return false;
+
+  *way = __builtin_ctz(invalid);
+  return true;
+}
+
+bool replacement_policy_parse(const char* name, ReplacementPolicy* policy) {
+  for (size_t i = 0; i < sizeof(policy_names) / sizeof(policy_names[0]); i++) {
+    if (strcmp(name, policy_names[i])) continue;
+
+    *policy = (ReplacementPolicy) i;
+    return true;
+  }
+
+  return false;
+}
+
+const char* replacement_policy_name(const ReplacementPolicy policy) {
+  return policy_names[policy];
+}
+
+bool page_policy_parse(const char* name, PageReplacementPolicy* policy) {
+  for (size_t i = 0; i < sizeof(page_policy_names) / sizeof(page_policy_names[0]); i++) {
+    if (strcmp(name, page_policy_names[i])) continue;
+
+    *policy = (PageReplacementPolicy) i;
+    return true;
+  }
+
+  return false;
+}
+
+const char* page_policy_name(const PageReplacementPolicy policy) {
+  return page_policy_names[policy];
+}
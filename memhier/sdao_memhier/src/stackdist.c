@@ -0,0 +1,226 @@
+#include <stdlib.h>
+#include <string.h>
+#include "stackdist.h"
+#include "util.h"
+
+#define STACKDIST_MIN_TIMES 16u
+#define STACKDIST_MIN_HASH  1024u
+
+// marks an empty time slot or hash slot
+#define STACKDIST_NONE UINT32_MAX
+
+typedef struct StackDistSet StackDistSet;
+
+// Each line has exactly one mark, at the time of its latest access.
+// The stack distance of a reuse is the number of marks between the line's previous access and now.
+struct StackDistSet {
+  uint32_t* tree;     // Fenwick tree over the marks (1-based)
+  uint32_t* owner;    // line id that owns each time, or STACKDIST_NONE once superseded
+  uint32_t cap;       // number of times before the set has to be compacted
+  uint32_t now;       // next time to hand out
+  uint32_t live;      // number of marks (distinct lines seen in this set)
+};
+
+struct StackDist {
+  size_t num_sets;
+  size_t max_ways;
+  size_t line_bits;
+  uint32_t set_mask;
+
+  StackDistSet* sets;
+
+  // distinct lines, indexed by line id
+  uint32_t* line_addr;
+  uint32_t* line_time;
+  size_t num_lines;
+  size_t lines_cap;
+
+  // open addressing map from line address to line id
+  uint32_t* hash;
+  size_t hash_cap;
+
+  // hist[d] counts reuses at stack distance d, anything further is counted in `beyond`
+  uint64_t* hist;
+  uint64_t beyond;
+  uint64_t cold;
+  uint64_t references;
+};
+
+StackDist* stackdist_new(const size_t num_sets, const size_t line_size, const size_t max_ways) {
+  StackDist* sd = calloc(1, sizeof(StackDist));
+  sd->num_sets = num_sets;
+  sd->max_ways = max_ways;
+  sd->line_bits = log_2(line_size);
+  sd->set_mask = num_sets - 1;
+
+  sd->sets = calloc(num_sets, sizeof(StackDistSet));
+  sd->hist = calloc(max_ways, sizeof(uint64_t));
+
+  sd->hash_cap = STACKDIST_MIN_HASH;
+  sd->hash = malloc(sizeof(uint32_t) * sd->hash_cap);
+  memset(sd->hash, 0xff, sizeof(uint32_t) * sd->hash_cap);
+
+  return sd;
+}
+
+void stackdist_free(StackDist* sd) {
+  for (size_t i = 0; i < sd->num_sets; i++) {
+    free(sd->sets[i].tree);
+    free(sd->sets[i].owner);
+  }
+
+  free(sd->sets);
+  free(sd->line_addr);
+  free(sd->line_time);
+  free(sd->hash);
+  free(sd->hist);
+  free(sd);
+}
+
+static inline uint32_t _stackdist_hash(const uint32_t line) {
+  return line * 2654435761u;
+}
+
+static void _stackdist_hash_grow(StackDist* sd) {
+  free(sd->hash);
+  sd->hash_cap *= 2;
+  sd->hash = malloc(sizeof(uint32_t) * sd->hash_cap);
+  memset(sd->hash, 0xff, sizeof(uint32_t) * sd->hash_cap);
+
+  // reinsert every line
+  for (uint32_t id = 0; id < sd->num_lines; id++) {
+    size_t slot = _stackdist_hash(sd->line_addr[id]) & (sd->hash_cap - 1);
+    while (sd->hash[slot] != STACKDIST_NONE)
+      slot = (slot + 1) & (sd->hash_cap - 1);
+    sd->hash[slot] = id;
+  }
+}
+
+// returns the id of `line`, or STACKDIST_NONE after registering it as a new line in `id`
+static uint32_t _stackdist_lookup(StackDist* sd, const uint32_t line, uint32_t* id) {
+  size_t slot = _stackdist_hash(line) & (sd->hash_cap - 1);
+
+  for (; sd->hash[slot] != STACKDIST_NONE; slot = (slot + 1) & (sd->hash_cap - 1)) {
+    if (sd->line_addr[sd->hash[slot]] == line) {
+      *id = sd->hash[slot];
+      return *id;
+    }
+  }
+
+  // new line
+  if (sd->num_lines == sd->lines_cap) {
+    sd->lines_cap = sd->lines_cap ? sd->lines_cap * 2 : STACKDIST_MIN_HASH;
+    sd->line_addr = realloc(sd->line_addr, sizeof(uint32_t) * sd->lines_cap);
+    sd->line_time = realloc(sd->line_time, sizeof(uint32_t) * sd->lines_cap);
+  }
+
+  *id = sd->num_lines++;
+  sd->line_addr[*id] = line;
+  sd->hash[slot] = *id;
+
+  // keep the load factor under a half
+  if (sd->num_lines * 2 > sd->hash_cap)
+    _stackdist_hash_grow(sd);
+
+  return STACKDIST_NONE;
+}
+
+static inline void _stackdist_tree_add(StackDistSet* set, uint32_t time, const uint32_t delta) {
+  for (time += 1; time <= set->cap; time += time & -time)
+    set->tree[time] += delta;
+}
+
+// number of marks at times [0, time)
+static inline uint32_t _stackdist_tree_prefix(const StackDistSet* set, uint32_t time) {
+  uint32_t sum = 0;
+  for (; time; time -= time & -time)
+    sum += set->tree[time];
+  return sum;
+}
+
+// squeezes the live marks of a set to the front of its time axis and resizes it to
+// twice the number of live lines, so the axis stays O(M) no matter how long the trace is
+static void _stackdist_compact(StackDist* sd, StackDistSet* set) {
+  uint32_t live = 0;
+
+  for (uint32_t t = 0; t < set->now; t++) {
+    uint32_t id = set->owner[t];
+    if (id == STACKDIST_NONE) continue;
+
+    set->owner[live] = id;
+    sd->line_time[id] = live;
+    live += 1;
+  }
+
+  uint32_t cap = live * 2 > STACKDIST_MIN_TIMES ? live * 2 : STACKDIST_MIN_TIMES;
+  if (cap != set->cap) {
+    set->owner = realloc(set->owner, sizeof(uint32_t) * cap);
+    set->tree = realloc(set->tree, sizeof(uint32_t) * (cap + 1));
+    set->cap = cap;
+  }
+
+  // linear time Fenwick build: every time below `live` holds a mark
+  memset(set->tree, 0, sizeof(uint32_t) * (cap + 1));
+  for (uint32_t i = 1; i <= cap; i++) {
+    set->tree[i] += i <= live;
+    uint32_t parent = i + (i & -i);
+    if (parent <= cap) set->tree[parent] += set->tree[i];
+  }
+
+  set->now = live;
+  set->live = live;
+}
+
+void stackdist_access(StackDist* sd, const uint32_t address) {
+  uint32_t line = address >> sd->line_bits;
+  StackDistSet* set = sd->sets + (line & sd->set_mask);
+  uint32_t id;
+
+  sd->references += 1;
+
+  if (set->now == set->cap)
+    _stackdist_compact(sd, set);
+
+  if (_stackdist_lookup(sd, line, &id) == STACKDIST_NONE) {
+    sd->cold += 1;
+    set->live += 1;
+  } else {
+    uint32_t last = sd->line_time[id];
+    uint32_t distance = set->live - _stackdist_tree_prefix(set, last + 1);
+
+    if (distance < sd->max_ways)
+      sd->hist[distance] += 1;
+    else
+      sd->beyond += 1;
+
+    // drop the old mark
+    _stackdist_tree_add(set, last, -1u);
+    set->owner[last] = STACKDIST_NONE;
+  }
+
+  // mark the line at the current time
+  _stackdist_tree_add(set, set->now, 1);
+  set->owner[set->now] = id;
+  sd->line_time[id] = set->now;
+  set->now += 1;
+}
+
+void stackdist_print(const StackDist* sd, FILE* f) {
+  size_t line_size = 1lu << sd->line_bits;
+
+  fprintf(f, "Stack distance analysis\n\n");
+  fprintf(f, "%-17s: %lu\n", "Number of sets", sd->num_sets);
+  fprintf(f, "%-17s: %lu\n", "Line size", line_size);
+  fprintf(f, "%-17s: %lu\n", "References", sd->references);
+  fprintf(f, "%-17s: %lu\n", "Distinct lines", sd->num_lines);
+  fprintf(f, "%-17s: %lu\n\n", "Cold misses", sd->cold);
+
+  fprintf(f, "%5s %10s %12s %12s %9s\n", "Ways", "Bytes", "Hits", "Misses", "Hit ratio");
+  fprintf(f, "----- ---------- ------------ ------------ ---------\n");
+
+  uint64_t hits = 0;
+  for (size_t ways = 1; ways <= sd->max_ways; ways++) {
+    hits += sd->hist[ways - 1];
+    fprintf(f, "%5lu %10lu %12lu %12lu %9lf\n", ways, ways * sd->num_sets * line_size, hits, sd->references - hits, sd->references ? (double) hits / (double) sd->references : 0.0);
+  }
+}
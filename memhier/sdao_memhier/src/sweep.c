@@ -0,0 +1,278 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "config.h"
+#include "hierarchy.h"
+#include "sweep.h"
+
+// references decoded per chunk. the reader fills one chunk while the workers simulate the other.
+#define SWEEP_CHUNK_SIZE (1u << 16)
+
+typedef struct SweepChunk SweepChunk;
+typedef struct SweepShared SweepShared;
+typedef struct SweepWorker SweepWorker;
+
+struct SweepChunk {
+  size_t len;
+  uint64_t addresses[SWEEP_CHUNK_SIZE];
+  uint32_t cores[SWEEP_CHUNK_SIZE];
+  TraceAccess accesses[SWEEP_CHUNK_SIZE];
+
+  // set partitioned runs: the references of partition p are order[first[p]] to order[first[p + 1] - 1], in trace order
+  uint32_t order[SWEEP_CHUNK_SIZE];
+  size_t* first;
+};
+
+struct SweepShared {
+  SweepChunk chunks[2];
+  size_t cur;
+
+  // set partitioned runs hand every partition only the references of its sets, 0 feeds every reference to every hierarchy
+  size_t parts;
+  size_t part_pos;          // lowest address bit of the partition number
+  const Hierarchy* router;  // partition 0, whose limits tell which references get rejected
+  size_t* cursor;           // where the next reference of each partition goes while routing
+
+  // the reader and every worker meet here once a chunk is ready and once it's consumed
+  pthread_barrier_t barrier;
+};
+
+struct SweepWorker {
+  pthread_t thread;
+  SweepShared* shared;
+
+  // the slice of hierarchies owned by this worker, starting at hierarchy `offset`
+  Hierarchy** hierarchies;
+  size_t num_hierarchies;
+  size_t offset;
+};
+
+// the partition whose sets reference `i` goes to. rejected references all go to partition 0, which counts them
+static size_t _sweep_owner(const SweepShared* shared, const SweepChunk* chunk, const size_t i) {
+  const Hierarchy* router = shared->router;
+
+  if (chunk->addresses[i] > router->max_address || chunk->cores[i] >= router->cores) return 0;
+  return ((uint32_t) chunk->addresses[i] & router->sample_mask) >> shared->part_pos;
+}
+
+// sorts the references of `chunk` into the lists of the partitions by counting
+static void _sweep_route(SweepShared* shared, SweepChunk* chunk) {
+  size_t* first = chunk->first;
+
+  for (size_t p = 0; p <= shared->parts; p++)
+    first[p] = 0;
+  for (size_t i = 0; i < chunk->len; i++)
+    first[_sweep_owner(shared, chunk, i) + 1] += 1;
+  for (size_t p = 0; p < shared->parts; p++) {
+    first[p + 1] += first[p];
+    shared->cursor[p] = first[p];
+  }
+
+  for (size_t i = 0; i < chunk->len; i++)
+    chunk->order[shared->cursor[_sweep_owner(shared, chunk, i)]++] = (uint32_t) i;
+}
+
+// decodes up to SWEEP_CHUNK_SIZE references into `chunk` and routes them when the run is set partitioned
+// returns false on a bad access type
+static bool _sweep_fill(Trace* trace, SweepShared* shared, SweepChunk* chunk) {
+  TraceStatus status;
+  bool ok = true;
+
+  chunk->len = 0;
+  while (chunk->len < SWEEP_CHUNK_SIZE && (status = trace_next(trace, chunk->accesses + chunk->len, chunk->addresses + chunk->len, chunk->cores + chunk->len)) != TRACE_END) {
+    if (status == TRACE_SKIP) {
+      fprintf(stderr, "failed to parse\n");
+      continue;
+    }
+
+    if (status == TRACE_BAD_TYPE) {
+      fprintf(stderr, "hierarchy: unexpected access type\n");
+      ok = false;
+      break;
+    }
+
+    chunk->len += 1;
+  }
+
+  if (shared->parts)
+    _sweep_route(shared, chunk);
+  return ok;
+}
+
+// simulates the references of `chunk` that belong to partition `part`, the others only count as skipped
+static void _sweep_partition(Hierarchy* hierarchy, const SweepChunk* chunk, const size_t part) {
+  uint32_t paddress;
+  size_t next = 0;
+
+  for (size_t k = chunk->first[part]; k < chunk->first[part + 1]; k++) {
+    size_t i = chunk->order[k];
+
+    hierarchy_skip(hierarchy, i - next);
+    hierarchy_access(hierarchy, chunk->cores[i], chunk->accesses[i], chunk->addresses[i], &paddress);
+    next = i + 1;
+  }
+
+  hierarchy_skip(hierarchy, chunk->len - next);
+}
+
+static void* _sweep_worker(void* arg) {
+  SweepWorker* worker = arg;
+  SweepShared* shared = worker->shared;
+  uint32_t paddress;
+
+  for (;;) {
+    // wait for a chunk, an empty chunk means the trace is done
+    pthread_barrier_wait(&shared->barrier);
+    const SweepChunk* chunk = shared->chunks + shared->cur;
+    if (!chunk->len) break;
+
+    for (size_t h = 0; h < worker->num_hierarchies; h++) {
+      Hierarchy* hierarchy = worker->hierarchies[h];
+      if (shared->parts) {
+        _sweep_partition(hierarchy, chunk, worker->offset + h);
+        continue;
+      }
+
+      for (size_t i = 0; i < chunk->len; i++)
+        hierarchy_access(hierarchy, chunk->cores[i], chunk->accesses[i], chunk->addresses[i], &paddress);
+    }
+
+    pthread_barrier_wait(&shared->barrier);
+  }
+
+  return NULL;
+}
+
+// `route`: the hierarchies are the partitions of one configuration, in order, and only get the references of their sets
+static bool _sweep_simulate(Trace* trace, Hierarchy** hierarchies, const size_t num_hierarchies, size_t num_threads, const bool route) {
+  if (num_threads > num_hierarchies) num_threads = num_hierarchies;
+  if (num_threads == 0) num_threads = 1;
+
+  SweepShared* shared = malloc(sizeof(SweepShared));
+  SweepWorker* workers = calloc(num_threads, sizeof(SweepWorker));
+  pthread_barrier_init(&shared->barrier, NULL, num_threads + 1);
+
+  shared->parts = route ? num_hierarchies : 0;
+  shared->router = hierarchies[0];
+  shared->part_pos = route ? (size_t) __builtin_ctz(hierarchies[0]->sample_mask) : 0;
+  shared->cursor = route ? calloc(num_hierarchies, sizeof(size_t)) : NULL;
+  for (size_t c = 0; c < 2; c++)
+    shared->chunks[c].first = route ? calloc(num_hierarchies + 1, sizeof(size_t)) : NULL;
+
+  // hand each worker a contiguous slice of the hierarchies
+  for (size_t t = 0, first = 0; t < num_threads; t++) {
+    size_t count = num_hierarchies / num_threads + (t < num_hierarchies % num_threads);
+
+    workers[t].shared = shared;
+    workers[t].hierarchies = hierarchies + first;
+    workers[t].num_hierarchies = count;
+    workers[t].offset = first;
+    pthread_create(&workers[t].thread, NULL, _sweep_worker, workers + t);
+
+    first += count;
+  }
+
+  // DECODE ONCE, SIMULATE EVERYWHERE
+  bool ok = _sweep_fill(trace, shared, shared->chunks);
+  shared->cur = 0;
+  for (;;) {
+    // release the current chunk to the workers
+    pthread_barrier_wait(&shared->barrier);
+    if (!shared->chunks[shared->cur].len) break;
+
+    // decode the next chunk while the workers run
+    SweepChunk* next = shared->chunks + (shared->cur ^ 1);
+    if (ok)
+      ok = _sweep_fill(trace, shared, next);
+    else
+      next->len = 0;
+
+    pthread_barrier_wait(&shared->barrier);
+    shared->cur ^= 1;
+  }
+
+  for (size_t t = 0; t < num_threads; t++)
+    pthread_join(workers[t].thread, NULL);
+
+  pthread_barrier_destroy(&shared->barrier);
+  free(shared->chunks[0].first);
+  free(shared->chunks[1].first);
+  free(shared->cursor);
+  free(workers);
+  free(shared);
+
+  return ok;
+}
+
+bool sweep_simulate(Trace* trace, Hierarchy** hierarchies, const size_t num_hierarchies, size_t num_threads) {
+  return _sweep_simulate(trace, hierarchies, num_hierarchies, num_threads, false);
+}
+
+int sweep_run(Trace* trace, char* const* config_files, const size_t num_configs, size_t num_threads, const size_t warmup, FILE* out) {
+  Config** configs = calloc(num_configs, sizeof(Config*));
+  Hierarchy** hierarchies = calloc(num_configs, sizeof(Hierarchy*));
+  int ret = 1;
+
+  // LOAD CONFIGURATIONS
+  for (size_t i = 0; i < num_configs; i++) {
+    configs[i] = read_config(config_files[i]);
+    if (!configs[i]) {
+      fprintf(stderr, "Failed to load configuration %s\n", config_files[i]);
+      goto L_sweep_cleanup;
+    }
+
+    hierarchies[i] = hierarchy_new(configs[i]);
+    if (!hierarchies[i]) goto L_sweep_cleanup;
+    hierarchy_warmup(hierarchies[i], warmup);
+  }
+
+  bool ok = sweep_simulate(trace, hierarchies, num_configs, num_threads);
+
+  // REPORT
+  hierarchy_print_csv_header(out);
+  for (size_t i = 0; i < num_configs; i++)
+    hierarchy_print_csv(hierarchies[i], config_files[i], out);
+
+  ret = ok ? 0 : 1;
+
+L_sweep_cleanup:
+  for (size_t i = 0; i < num_configs; i++) {
+    if (hierarchies[i]) hierarchy_free(hierarchies[i]);
+    if (configs[i]) free_config(configs[i]);
+  }
+  free(hierarchies);
+  free(configs);
+
+  return ret;
+}
+
+// Splits one physical address configuration into `parts` hierarchies that each own
+// 1 / `parts` of the dc and L2 sets, simulates them on their own threads and merges them.
+// returns the merged hierarchy, or NULL if the configuration can't be split that way
+Hierarchy* sweep_partitioned(Trace* trace, const Config* config, const size_t parts, const size_t warmup, bool* ok) {
+  Hierarchy** hierarchies = calloc(parts, sizeof(Hierarchy*));
+  Hierarchy* merged = NULL;
+
+  for (size_t i = 0; i < parts; i++) {
+    hierarchies[i] = hierarchy_new(config);
+    if (!hierarchies[i] || !hierarchy_partition(hierarchies[i], parts, i)) goto L_partition_cleanup;
+    hierarchy_warmup(hierarchies[i], warmup);
+  }
+
+  *ok = _sweep_simulate(trace, hierarchies, parts, parts, true);
+
+  // partition 0 got every rejected reference, only the cache counters add up
+  merged = hierarchies[0];
+  hierarchies[0] = NULL;
+  for (size_t i = 1; i < parts; i++)
+    hierarchy_merge(merged, hierarchies[i]);
+
+L_partition_cleanup:
+  for (size_t i = 0; i < parts; i++) {
+    if (hierarchies[i]) hierarchy_free(hierarchies[i]);
+  }
+  free(hierarchies);
+
+  return merged;
+}
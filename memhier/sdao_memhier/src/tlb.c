@@ -1,11 +1,13 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
-typedef struct TLBEntry TLBEntry;
 typedef struct DecodeConstants DecodeConstants;
 
-#include "set.h"
+#include "replace.h"
+#include "snapshot.h"
+#include "tagmatch.h"
 #include "tlb.h"
 #include "util.h"
 
@@ -13,17 +15,10 @@ struct DecodeConstants {
   size_t index_pos;
   size_t tag_pos;
 
-  uint32_t tag_mask;
   uint32_t index_mask;
   uint32_t offset_mask;
 };
 
-struct TLBEntry {
-  size_t page;
-  uint32_t tag;
-  bool   valid;
-};
-
 struct TLB {
   size_t num_sets;
   size_t set_size;
@@ -31,9 +26,27 @@ struct TLB {
 
   DecodeConstants decode;
 
-  Set** sets;
+  // Ways of a set are stored contiguously, so way `w` of set `i` lives at [i * set_size + w].
+  // valid is a per-set bitmask and replacer holds the replacement policy's metadata.
+  uint64_t* tags;
+  uint32_t* pages;
+  Replacer* replacer;
+  uint32_t* valid;
+
+  // reverse map from a physical page to the valid slots caching it. owners holds the first
+  // slot of each page's chain and next/prev link the slots, all stored as slot + 1 (0 ends a chain).
+  // a chain is normally one slot long, but nothing stops two virtual pages sharing a frame.
+  uint32_t* owners;
+  uint32_t* owner_next;
+  uint32_t* owner_prev;
+  size_t num_ppages;
+
   TLBStats* stats;
 
+  // latency model, `cycles` is the running cost of the current reference (NULL when not timed)
+  uint64_t* cycles;
+  size_t latency;
+
   PTable* ptable;
 };
 
@@ -43,26 +56,21 @@ void _TLB_calculate_decode(TLB* tlb) {
   decode->index_pos = log_2(tlb->page_size);
   decode->tag_pos = decode->index_pos + log_2(tlb->num_sets);
 
-  decode->tag_mask = ~((~0u) << decode->tag_pos);
   decode->index_mask = ~((~0u) << (decode->tag_pos - decode->index_pos));
   decode->offset_mask = ~((~0u) << decode->index_pos);
 
 }
 
-TLB* TLB_new(PTable* ptable, const size_t num_sets, const size_t set_size, const size_t page_size) {
+TLB* TLB_new(PTable* ptable, const size_t num_sets, const size_t set_size, const size_t page_size, const ReplacementPolicy replacement) {
   TLB* tlb = malloc(sizeof(TLB));
-  tlb->sets = malloc(sizeof(Set*) * num_sets);
-  
-  // make sets and TLBentries, connect them together
-  for (size_t i = 0; i < num_sets; i++) {
-    Set* set = tlb->sets[i] = Set_new(set_size);
-    
-    TLBEntry* entries = calloc(set_size + 1, sizeof(TLBEntry));
-
-    for (size_t i = 0; i < set_size + 1; i++) {
-      set->node_list[i].data = entries + i;
-    }
-  }
+  tlb->tags = calloc(num_sets * set_size, sizeof(uint64_t));
+  tlb->pages = calloc(num_sets * set_size, sizeof(uint32_t));
+  tlb->replacer = replacer_new(replacement, num_sets, set_size);
+  tlb->valid = calloc(num_sets, sizeof(uint32_t));
+  tlb->num_ppages = ptable_num_ppages(ptable);
+  tlb->owners = calloc(tlb->num_ppages, sizeof(uint32_t));
+  tlb->owner_next = calloc(num_sets * set_size, sizeof(uint32_t));
+  tlb->owner_prev = calloc(num_sets * set_size, sizeof(uint32_t));
 
   tlb->stats = calloc(1, sizeof(TLBStats));
   
@@ -71,80 +79,147 @@ TLB* TLB_new(PTable* ptable, const size_t num_sets, const size_t set_size, const
   tlb->set_size = set_size;
   tlb->page_size = page_size;
   tlb->ptable = ptable;
+  tlb->cycles = NULL;
+  tlb->latency = 0;
 
   _TLB_calculate_decode(tlb);
 
   return tlb;
 }
 void TLB_free(TLB* tlb) {
-  for(size_t i = 0; i < tlb->num_sets; i++) {
-    Set* set = tlb->sets[i];
-    free(set->node_list->data);
-    Set_free(set);
-  }
-
-  free(tlb->sets);
+  free(tlb->tags);
+  free(tlb->pages);
+  replacer_free(tlb->replacer);
+  free(tlb->valid);
+  free(tlb->owners);
+  free(tlb->owner_next);
+  free(tlb->owner_prev);
 
   free(tlb->stats);
   free(tlb);
 }
 
+bool TLB_save(const TLB* tlb, FILE* f) {
+  const size_t slots = tlb->num_sets * tlb->set_size;
+
+  return snapshot_write(f, tlb->tags, sizeof(uint64_t) * slots)
+    && snapshot_write(f, tlb->pages, sizeof(uint32_t) * slots)
+    && snapshot_write(f, tlb->valid, sizeof(uint32_t) * tlb->num_sets)
+    && snapshot_write(f, tlb->stats, sizeof(TLBStats))
+    && replacer_save(tlb->replacer, f);
+}
+
+void TLB_reset_stats(TLB* tlb) {
+  tlb->stats->hits = 0;
+  tlb->stats->total_accesses = 0;
+  tlb->stats->shootdowns = 0;
+}
+
 TLBStats* TLB_stats(const TLB* tlb) {
   return tlb->stats;
 }
 
-void _TLB_decode(TLB* tlb, uint32_t v_addr, uint32_t* tag, uint32_t* index) {
-  *tag = (v_addr >> tlb->decode.tag_pos) & tlb->decode.tag_mask;
+void _TLB_decode(TLB* tlb, uint64_t v_addr, uint64_t* tag, uint32_t* index) {
+  *tag = v_addr >> tlb->decode.tag_pos;
   *index = (v_addr >> tlb->decode.index_pos) & tlb->decode.index_mask; 
 }
 
-bool _TLB_get(TLB* tlb, const uint32_t tag, const uint32_t index, uint32_t* ppage, bool write) {
-  Set* set = tlb->sets[index];
-  TLBEntry* entry;
+// adds a valid slot to its page's chain
+void _TLB_link(TLB* tlb, const size_t slot) {
+  uint32_t* head = tlb->owners + tlb->pages[slot];
 
-  // attempt to find
-  SetNode* node;
-  SET_TRAVERSE_RIGHT(node, set->node_list) {
-    entry = (TLBEntry*) node->data;
-    if (entry->valid && entry->tag == tag) {
-
-      *ppage = entry->page;
-      Set_set_mru(set, node);
-      return true;
-    
+  tlb->owner_prev[slot] = 0;
+  tlb->owner_next[slot] = *head;
+  if (*head) tlb->owner_prev[*head - 1] = slot + 1;
+  *head = slot + 1;
+}
+
+// removes a valid slot from its page's chain
+void _TLB_unlink(TLB* tlb, const size_t slot) {
+  const uint32_t next = tlb->owner_next[slot];
+  const uint32_t prev = tlb->owner_prev[slot];
+
+  if (prev) tlb->owner_next[prev - 1] = next;
+  else tlb->owners[tlb->pages[slot]] = next;
+  if (next) tlb->owner_prev[next - 1] = prev;
+}
+
+// the reverse map isn't saved, it's rebuilt from the valid entries once they are known to be in range
+bool TLB_load(TLB* tlb, FILE* f) {
+  const size_t slots = tlb->num_sets * tlb->set_size;
+  const uint32_t ways = (uint32_t) ~(~0ull << tlb->set_size);
+  uint8_t hit;
+
+  if (!snapshot_read(f, tlb->tags, sizeof(uint64_t) * slots)
+      || !snapshot_read(f, tlb->pages, sizeof(uint32_t) * slots)
+      || !snapshot_read(f, tlb->valid, sizeof(uint32_t) * tlb->num_sets)
+      || !snapshot_read(f, tlb->stats, sizeof(TLBStats))
+      || !replacer_load(tlb->replacer, f))
+    return false;
+
+  memcpy(&hit, &tlb->stats->hit, 1);
+  if (hit > 1) return false;
+
+  memset(tlb->owners, 0, sizeof(uint32_t) * tlb->num_ppages);
+  for (size_t set = 0; set < tlb->num_sets; set++) {
+    if (tlb->valid[set] & ~ways) return false;
+
+    for (uint32_t valid = tlb->valid[set]; valid; valid &= valid - 1) {
+      const size_t slot = set * tlb->set_size + __builtin_ctz(valid);
+      if (tlb->pages[slot] >= tlb->num_ppages) return false;
+      _TLB_link(tlb, slot);
     }
   }
 
-  // find invalid or LRU
-  SET_TRAVERSE_LEFT(node, set->node_list) {
-    entry = (TLBEntry*) node->data;
-    if (entry->valid) continue;
-    else goto L_tlb_assign;
+  return true;
+}
+
+bool _TLB_get(TLB* tlb, const uint64_t tag, const uint32_t index, uint32_t* ppage, bool write) {
+  const size_t base = index * tlb->set_size;
+  size_t way;
+
+  // attempt to find
+  uint32_t hits = tag_match64(tlb->tags + base, tlb->set_size, tag) & tlb->valid[index];
+  if (hits) {
+    way = __builtin_ctz(hits);
+    *ppage = tlb->pages[base + way];
+    replacer_touch(tlb->replacer, index, way);
+    return true;
   }
-  node = Set_get_lru(set);
 
-L_tlb_assign:
-  // handoff translation to ptable
-  entry = (TLBEntry*) node->data;
+  // find invalid or victim
+  if (!replacer_find_invalid(tlb->replacer, index, tlb->valid[index], &way))
+    way = replacer_victim(tlb->replacer, index);
 
-  uint32_t reconstructed_v_addr = (tag & tlb->decode.tag_mask) << tlb->decode.tag_pos;
-  reconstructed_v_addr |= (index & tlb->decode.index_mask) << tlb->decode.index_pos;
+  // handoff translation to ptable
+  uint64_t reconstructed_v_addr = tag << tlb->decode.tag_pos;
+  reconstructed_v_addr |= (uint64_t)(index & tlb->decode.index_mask) << tlb->decode.index_pos;
   *ppage = ptable_virt_phys(tlb->ptable, reconstructed_v_addr, write) >> tlb->decode.index_pos;
 
+  // the victim's page is no longer cached here (a page fault above may have shot it down already)
+  if (tlb->valid[index] & (1u << way))
+    _TLB_unlink(tlb, base + way);
+
   // cache entry
-  entry->valid = true;
-  entry->tag = tag;
-  entry->page = *ppage;
+  tlb->valid[index] |= 1u << way;
+  tlb->tags[base + way] = tag;
+  tlb->pages[base + way] = *ppage;
+  _TLB_link(tlb, base + way);
 
-  // set mru
-  Set_set_mru(set, node);
+  replacer_fill(tlb->replacer, index, way);
   return false;
 }
 
-uint32_t TLB_virt_phys(TLB* tlb, const uint32_t v_addr, bool write) {
+void TLB_set_timing(TLB* tlb, uint64_t* cycles, const size_t latency) {
+  tlb->cycles = cycles;
+  tlb->latency = latency;
+}
+
+uint32_t TLB_virt_phys(TLB* tlb, const uint64_t v_addr, bool write) {
+  if (tlb->cycles) *tlb->cycles += tlb->latency;
   tlb->stats->total_accesses += 1;
   tlb->stats->offset = v_addr & tlb->decode.offset_mask;
-  tlb->stats->vpage = (v_addr >> tlb->decode.index_pos) & tlb->decode.tag_mask;
+  tlb->stats->vpage = v_addr >> tlb->decode.index_pos;
 
   _TLB_decode(tlb, v_addr, &tlb->stats->tag, &tlb->stats->index);
   tlb->stats->hit = _TLB_get(tlb, tlb->stats->tag, tlb->stats->index, &tlb->stats->ppage, write);
@@ -155,17 +230,13 @@ uint32_t TLB_virt_phys(TLB* tlb, const uint32_t v_addr, bool write) {
   return p_addr; 
 }
 
-// Traverse the entire TLB and invalidate any page mapping to 'ppage'
+// Invalidate every entry mapping to 'ppage' by walking its reverse map chain
 void TLB_invalidate_ppage(TLB* tlb, const uint32_t ppage) {
-  for (size_t i = 0; i < tlb->num_sets; i++) {
-    Set* set = tlb->sets[i];
-
-    SetNode* node;
-    SET_TRAVERSE_RIGHT(node, set->node_list) {
-      TLBEntry* entry = (TLBEntry*) node->data;
-      if (!entry->valid || entry->page != ppage) continue;
-      
-      entry->valid = false;
-    }
+  if (ppage >= tlb->num_ppages) return;
+
+  for (uint32_t slot = tlb->owners[ppage]; slot; slot = tlb->owner_next[slot - 1]) {
+    tlb->valid[(slot - 1) / tlb->set_size] &= ~(1u << ((slot - 1) % tlb->set_size));
+    tlb->stats->shootdowns += 1;
   }
+  tlb->owners[ppage] = 0;
 }
@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+#define LINESIZE 20
+
+// number of 32 bit words in a full block
+#define TRACE_BLOCK_WORDS (TRACE_BLOCK_SIZE + 1)
+
+struct Trace {
+  bool binary;
+
+  // text input
+  FILE* f;
+  char* buf;
+  size_t buf_size;
+
+  // binary input
+  void* map;
+  size_t map_size;
+  const uint32_t* blocks;
+  uint64_t count;
+  uint64_t pos;
+};
+
+struct TraceWriter {
+  FILE* f;
+  TraceHeader header;
+  uint32_t block[TRACE_BLOCK_WORDS];
+  uint32_t i;
+  bool failed;      // a write came up short, reported when the writer is closed
+};
+
+Trace* trace_open_text(FILE* f) {
+  Trace* trace = calloc(1, sizeof(Trace));
+  trace->f = f;
+  trace->buf_size = LINESIZE;
+  trace->buf = malloc(LINESIZE);
+
+  return trace;
+}
+
+// size in bytes a binary trace of `count` references should have
+static size_t _trace_binary_size(const uint64_t count) {
+  size_t size = sizeof(TraceHeader) + (count / TRACE_BLOCK_SIZE) * TRACE_BLOCK_WORDS * sizeof(uint32_t);
+  if (count % TRACE_BLOCK_SIZE)
+    size += (1 + count % TRACE_BLOCK_SIZE) * sizeof(uint32_t);
+
+  return size;
+}
+
+Trace* trace_open_binary(const char* filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    perror("Failed to open trace file");
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    perror("Failed to stat trace file");
+    close(fd);
+    return NULL;
+  }
+
+  if ((size_t) st.st_size < sizeof(TraceHeader)) {
+    fprintf(stderr, "Trace file is too small to be a binary trace.\n");
+    close(fd);
+    return NULL;
+  }
+
+  void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    perror("Failed to map trace file");
+    return NULL;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  const TraceHeader* header = map;
+  if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) || header->version != TRACE_VERSION) {
+    fprintf(stderr, "Trace file is not a version %u binary trace.\n", TRACE_VERSION);
+    munmap(map, st.st_size);
+    return NULL;
+  }
+
+  if (_trace_binary_size(header->count) != (size_t) st.st_size) {
+    fprintf(stderr, "Trace file size doesn't match its header.\n");
+    munmap(map, st.st_size);
+    return NULL;
+  }
+
+  Trace* trace = calloc(1, sizeof(Trace));
+  trace->binary = true;
+  trace->map = map;
+  trace->map_size = st.st_size;
+  trace->blocks = (const uint32_t*)(header + 1);
+  trace->count = header->count;
+
+  return trace;
+}
+
+void trace_close(Trace* trace) {
+  if (trace->map) munmap(trace->map, trace->map_size);
+  free(trace->buf);
+  free(trace);
+}
+
+static TraceStatus _trace_next_text(Trace* trace, TraceAccess* access, uint64_t* address, uint32_t* core) {
+  char read_write;
+
+  if (getline(&trace->buf, &trace->buf_size, trace->f) == -1)
+    return TRACE_END;
+
+  *core = 0;
+  if (sscanf(trace->buf, "%c:%" SCNx64 ":%" SCNu32, &read_write, address, core) < 2)
+    return TRACE_SKIP;
+
+  switch (read_write) {
+    case 'W':
+      *access = TRACE_WRITE;
+      return TRACE_OK;
+    case 'R':
+      *access = TRACE_READ;
+      return TRACE_OK;
+    case 'I':
+      *access = TRACE_FETCH;
+      return TRACE_OK;
+    default:
+      return TRACE_BAD_TYPE;
+  }
+}
+
+TraceStatus trace_next(Trace* trace, TraceAccess* access, uint64_t* address, uint32_t* core) {
+  if (!trace->binary)
+    return _trace_next_text(trace, access, address, core);
+
+  if (trace->pos == trace->count)
+    return TRACE_END;
+
+  const uint32_t* block = trace->blocks + (trace->pos / TRACE_BLOCK_SIZE) * TRACE_BLOCK_WORDS;
+  uint32_t i = trace->pos % TRACE_BLOCK_SIZE;
+
+  *access = (block[0] >> i) & 1u ? TRACE_WRITE : TRACE_READ;
+  *address = block[1 + i];
+  *core = 0;
+  trace->pos += 1;
+
+  return TRACE_OK;
+}
+
+TraceWriter* trace_writer_open(const char* filename) {
+  FILE* f = fopen(filename, "wb");
+  if (!f) {
+    perror("Failed to open output trace file");
+    return NULL;
+  }
+
+  TraceWriter* writer = calloc(1, sizeof(TraceWriter));
+  writer->f = f;
+  memcpy(writer->header.magic, TRACE_MAGIC, sizeof(writer->header.magic));
+  writer->header.version = TRACE_VERSION;
+  writer->failed = fwrite(&writer->header, sizeof(writer->header), 1, f) != 1;
+
+  return writer;
+}
+
+void trace_writer_put(TraceWriter* writer, const bool write, const uint32_t address) {
+  writer->block[0] |= (uint32_t) write << writer->i;
+  writer->block[1 + writer->i] = address;
+  writer->header.count += 1;
+
+  // flush full blocks
+  if (++writer->i == TRACE_BLOCK_SIZE) {
+    if (fwrite(writer->block, sizeof(uint32_t), TRACE_BLOCK_WORDS, writer->f) != TRACE_BLOCK_WORDS)
+      writer->failed = true;
+    writer->block[0] = 0;
+    writer->i = 0;
+  }
+}
+
+long trace_writer_close(TraceWriter* writer) {
+  // flush the partial block
+  if (writer->i && fwrite(writer->block, sizeof(uint32_t), 1 + writer->i, writer->f) != 1 + writer->i)
+    writer->failed = true;
+
+  // fill in the final count
+  rewind(writer->f);
+  if (fwrite(&writer->header, sizeof(writer->header), 1, writer->f) != 1)
+    writer->failed = true;
+
+  long count = writer->header.count;
+  if (fclose(writer->f) || writer->failed) {
+    perror("Failed to write output trace file");
+    count = -1;
+  }
+
+  free(writer);
+  return count;
+}
+
+long trace_convert(FILE* in, const char* filename) {
+  TraceWriter* out = trace_writer_open(filename);
+  if (!out) return -1;
+
+  Trace* trace = trace_open_text(in);
+  TraceAccess access;
+  uint64_t address;
+  uint32_t core;
+  TraceStatus status;
+
+  while ((status = trace_next(trace, &access, &address, &core)) != TRACE_END) {
+    if (status == TRACE_SKIP) {
+      fprintf(stderr, "failed to parse\n");
+      continue;
+    }
+    if (status == TRACE_BAD_TYPE) {
+      fprintf(stderr, "hierarchy: unexpected access type\n");
+      break;
+    }
+    if (address > UINT32_MAX) {
+      fprintf(stderr, "address %" PRIx64 " doesn't fit in a binary trace\n", address);
+      status = TRACE_BAD_TYPE;
+      break;
+    }
+    if (core) {
+      fprintf(stderr, "binary traces only hold core 0 references\n");
+      status = TRACE_BAD_TYPE;
+      break;
+    }
+    if (access == TRACE_FETCH) {
+      fprintf(stderr, "binary traces don't hold instruction fetches\n");
+      status = TRACE_BAD_TYPE;
+      break;
+    }
+
+    trace_writer_put(out, access == TRACE_WRITE, address);
+  }
+
+  trace_close(trace);
+
+  long count = trace_writer_close(out);
+  return status == TRACE_BAD_TYPE ? -1 : count;
+}
@@ -0,0 +1,381 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include "tracegen.h"
+#include "writer.h"
+
+#define TRACEGEN_WORD 4u
+
+static const char* pattern_names[] = {
+  [PATTERN_SEQUENTIAL] = "sequential",
+  [PATTERN_STRIDED] = "strided",
+  [PATTERN_UNIFORM] = "uniform",
+  [PATTERN_ZIPF] = "zipf",
+  [PATTERN_CHASE] = "chase",
+};
+
+typedef struct Zipf Zipf;
+typedef struct TraceGen TraceGen;
+
+// rejection-inversion sampling (Hörmann and Derflinger), constant time per sample without a table
+struct Zipf {
+  double n;
+  double alpha;
+  double h_x1;    // H(1.5) - 1
+  double h_n;     // H(n + 0.5)
+  double s;
+};
+
+struct TraceGen {
+  const TraceGenSpec* spec;
+  uint64_t rng[4];    // xoshiro256**
+  uint64_t offset;    // from the base, sequential and strided
+  uint64_t items;     // words (uniform) or lines (zipf, chase)
+  uint32_t* next;     // the chase cycle, next[node] follows node
+  uint32_t node;
+  Zipf zipf;
+};
+
+bool trace_pattern_parse(const char* name, TracePattern* pattern) {
+  for (size_t i = 0; i < sizeof(pattern_names) / sizeof(pattern_names[0]); i++) {
+    if (strcmp(name, pattern_names[i])) continue;
+
+    *pattern = (TracePattern) i;
+    return true;
+  }
+
+  return false;
+}
+
+const char* trace_pattern_name(const TracePattern pattern) {
+  return pattern_names[pattern];
+}
+
+// RANDOM NUMBERS
+
+static uint64_t _tracegen_splitmix(uint64_t* x) {
+  uint64_t z = (*x += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+static inline uint64_t _tracegen_rotl(const uint64_t x, const int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t _tracegen_random(TraceGen* gen) {
+  uint64_t* s = gen->rng;
+  const uint64_t result = _tracegen_rotl(s[1] * 5, 7) * 9;
+  const uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = _tracegen_rotl(s[3], 45);
+
+  return result;
+}
+
+// uniform in [0, 1)
+static inline double _tracegen_unit(TraceGen* gen) {
+  return (double)(_tracegen_random(gen) >> 11) * 0x1.0p-53;
+}
+
+// ZIPF
+
+// log1p(x) / x, accurate around 0
+static double _zipf_helper1(const double x) {
+  if (fabs(x) > 1e-8) return log1p(x) / x;
+  return 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+}
+
+// expm1(x) / x, accurate around 0
+static double _zipf_helper2(const double x) {
+  if (fabs(x) > 1e-8) return expm1(x) / x;
+  return 1.0 + x * 0.5 * (1.0 + x / 3.0 * (1.0 + 0.25 * x));
+}
+
+static double _zipf_h(const Zipf* zipf, const double x) {
+  return exp(-zipf->alpha * log(x));
+}
+
+// integral of h, (x^(1 - alpha) - 1) / (1 - alpha)
+static double _zipf_h_integral(const Zipf* zipf, const double x) {
+  const double log_x = log(x);
+  return _zipf_helper2((1.0 - zipf->alpha) * log_x) * log_x;
+}
+
+static double _zipf_h_integral_inverse(const Zipf* zipf, const double x) {
+  double t = x * (1.0 - zipf->alpha);
+  if (t < -1.0) t = -1.0;
+  return exp(_zipf_helper1(t) * x);
+}
+
+static void _zipf_init(Zipf* zipf, const uint64_t n, const double alpha) {
+  zipf->n = (double) n;
+  zipf->alpha = alpha;
+  zipf->h_x1 = _zipf_h_integral(zipf, 1.5) - 1.0;
+  zipf->h_n = _zipf_h_integral(zipf, zipf->n + 0.5);
+  zipf->s = 2.0 - _zipf_h_integral_inverse(zipf, _zipf_h_integral(zipf, 2.5) - _zipf_h(zipf, 2.0));
+}
+
+// returns a rank from 1 to n, rank k is drawn with probability proportional to k^-alpha
+static uint64_t _zipf_sample(const Zipf* zipf, TraceGen* gen) {
+  for (;;) {
+    const double u = zipf->h_n + _tracegen_unit(gen) * (zipf->h_x1 - zipf->h_n);
+    const double x = _zipf_h_integral_inverse(zipf, u);
+    double k = floor(x + 0.5);
+
+    if (k < 1.0) k = 1.0;
+    else if (k > zipf->n) k = zipf->n;
+
+    if (k - x <= zipf->s || u >= _zipf_h_integral(zipf, k + 0.5) - _zipf_h(zipf, k))
+      return (uint64_t) k;
+  }
+}
+
+// SPEC
+
+static bool _tracegen_number(const char* key, const char* value, uint64_t* number) {
+  char* end;
+
+  *number = strtoull(value, &end, 0);
+  if (*value && !*end && *value != '-') return true;
+
+  fprintf(stderr, "Expected a number for %s.\n", key);
+  return false;
+}
+
+static bool _tracegen_fraction(const char* key, const char* value, double* fraction) {
+  char* end;
+
+  *fraction = strtod(value, &end);
+  if (*value && !*end) return true;
+
+  fprintf(stderr, "Expected a number for %s.\n", key);
+  return false;
+}
+
+static bool _tracegen_option(TraceGenSpec* spec, const char* key, const char* value) {
+  if (!strcmp(key, "count"))
+    return _tracegen_number(key, value, &spec->count);
+  if (!strcmp(key, "base"))
+    return _tracegen_number(key, value, &spec->base);
+  if (!strcmp(key, "footprint"))
+    return _tracegen_number(key, value, &spec->footprint);
+  if (!strcmp(key, "stride"))
+    return _tracegen_number(key, value, &spec->stride);
+  if (!strcmp(key, "line"))
+    return _tracegen_number(key, value, &spec->line);
+  if (!strcmp(key, "seed"))
+    return _tracegen_number(key, value, &spec->seed);
+  if (!strcmp(key, "alpha"))
+    return _tracegen_fraction(key, value, &spec->alpha);
+  if (!strcmp(key, "writes"))
+    return _tracegen_fraction(key, value, &spec->writes);
+
+  fprintf(stderr, "Unknown trace option \"%s\", expected count, base, footprint, stride, line, alpha, writes or seed.\n", key);
+  return false;
+}
+
+static bool _tracegen_validate(const TraceGenSpec* spec) {
+  if (spec->footprint < TRACEGEN_WORD) {
+    fprintf(stderr, "The footprint should be at least %u bytes.\n", TRACEGEN_WORD);
+    return false;
+  } else if (spec->base + spec->footprint - 1 < spec->base) {
+    fprintf(stderr, "The footprint runs past the end of the address space.\n");
+    return false;
+  } else if (spec->pattern == PATTERN_STRIDED && !spec->stride) {
+    fprintf(stderr, "The stride should be positive.\n");
+    return false;
+  } else if (!spec->line || spec->line > spec->footprint) {
+    fprintf(stderr, "The line should be between 1 byte and the footprint.\n");
+    return false;
+  } else if (spec->pattern == PATTERN_CHASE && spec->footprint / spec->line > UINT32_MAX) {
+    fprintf(stderr, "A pointer chase can have at most %u nodes.\n", UINT32_MAX);
+    return false;
+  } else if (!(spec->alpha > 0)) {
+    fprintf(stderr, "The zipf exponent should be positive.\n");
+    return false;
+  } else if (!(spec->writes >= 0 && spec->writes <= 1)) {
+    fprintf(stderr, "The write fraction should be between 0 and 1.\n");
+    return false;
+  }
+
+  return true;
+}
+
+bool tracegen_parse(const char* str, TraceGenSpec* spec) {
+  spec->count = 1000000;
+  spec->base = 0;
+  spec->footprint = 1u << 20;
+  spec->stride = 64;
+  spec->line = 64;
+  spec->alpha = 0.99;
+  spec->writes = 0;
+  spec->seed = 1;
+
+  char* copy = strdup(str);
+  char* save;
+  char* pattern = strtok_r(copy, ",", &save);
+  bool ok = true;
+
+  if (!pattern || !trace_pattern_parse(pattern, &spec->pattern)) {
+    fprintf(stderr, "Expected a trace pattern, one of sequential, strided, uniform, zipf or chase.\n");
+    ok = false;
+  }
+
+  for (char* option; ok && (option = strtok_r(NULL, ",", &save));) {
+    char* value = strchr(option, '=');
+    if (!value) {
+      fprintf(stderr, "Expected key=value, got \"%s\".\n", option);
+      ok = false;
+      break;
+    }
+
+    *value++ = '\0';
+    ok = _tracegen_option(spec, option, value);
+  }
+
+  free(copy);
+  return ok && _tracegen_validate(spec);
+}
+
+// GENERATION
+
+static bool _tracegen_init(TraceGen* gen, const TraceGenSpec* spec) {
+  memset(gen, 0, sizeof(TraceGen));
+  gen->spec = spec;
+
+  uint64_t x = spec->seed;
+  for (size_t i = 0; i < 4; i++)
+    gen->rng[i] = _tracegen_splitmix(&x);
+
+  switch (spec->pattern) {
+    case PATTERN_UNIFORM:
+      gen->items = spec->footprint / TRACEGEN_WORD;
+      break;
+    case PATTERN_ZIPF:
+      gen->items = spec->footprint / spec->line;
+      _zipf_init(&gen->zipf, gen->items, spec->alpha);
+      break;
+    case PATTERN_CHASE:
+      gen->items = spec->footprint / spec->line;
+      gen->next = malloc(sizeof(uint32_t) * gen->items);
+      if (!gen->next) {
+        fprintf(stderr, "Not enough memory for a %" PRIu64 " node pointer chase.\n", gen->items);
+        return false;
+      }
+
+      // Sattolo's shuffle leaves a single cycle through every node
+      for (uint64_t i = 0; i < gen->items; i++)
+        gen->next[i] = i;
+      for (uint64_t i = gen->items - 1; i > 0; i--) {
+        uint64_t j = _tracegen_random(gen) % i;
+        uint32_t tmp = gen->next[i];
+        gen->next[i] = gen->next[j];
+        gen->next[j] = tmp;
+      }
+      break;
+    default:
+      break;
+  }
+
+  return true;
+}
+
+static inline uint64_t _tracegen_next(TraceGen* gen, bool* write) {
+  const TraceGenSpec* spec = gen->spec;
+  uint64_t offset;
+
+  switch (spec->pattern) {
+    case PATTERN_SEQUENTIAL:
+    case PATTERN_STRIDED:
+      offset = gen->offset;
+      gen->offset += spec->pattern == PATTERN_SEQUENTIAL ? TRACEGEN_WORD : spec->stride;
+      if (gen->offset >= spec->footprint)
+        gen->offset %= spec->footprint;
+      break;
+    case PATTERN_UNIFORM:
+      offset = (_tracegen_random(gen) % gen->items) * TRACEGEN_WORD;
+      break;
+    case PATTERN_ZIPF:
+      offset = (_zipf_sample(&gen->zipf, gen) - 1) * spec->line;
+      break;
+    case PATTERN_CHASE:
+    default:
+      offset = (uint64_t) gen->node * spec->line;
+      gen->node = gen->next[gen->node];
+      break;
+  }
+
+  *write = spec->writes > 0 && _tracegen_unit(gen) < spec->writes;
+  return spec->base + offset;
+}
+
+bool tracegen_text(const TraceGenSpec* spec, FILE* f) {
+  TraceGen gen;
+  if (!_tracegen_init(&gen, spec)) return false;
+
+  Writer* out = writer_new(f);
+  bool write;
+
+  for (uint64_t i = 0; i < spec->count; i++) {
+    uint64_t address = _tracegen_next(&gen, &write);
+
+    writer_char(out, write ? 'W' : 'R');
+    writer_char(out, ':');
+    writer_hex(out, address, 0, false);
+    writer_char(out, '\n');
+  }
+
+  writer_free(out);
+  free(gen.next);
+
+  if (fflush(f) || ferror(f)) {
+    perror("Failed to write trace");
+    return false;
+  }
+
+  return true;
+}
+
+bool tracegen_fill(const TraceGenSpec* spec, uint64_t* addresses, bool* writes) {
+  TraceGen gen;
+  if (!_tracegen_init(&gen, spec)) return false;
+
+  for (uint64_t i = 0; i < spec->count; i++)
+    addresses[i] = _tracegen_next(&gen, writes + i);
+
+  free(gen.next);
+  return true;
+}
+
+long tracegen_binary(const TraceGenSpec* spec, const char* filename) {
+  if (spec->base + spec->footprint - 1 > UINT32_MAX) {
+    fprintf(stderr, "Binary traces only hold 32 bit addresses.\n");
+    return -1;
+  }
+
+  TraceGen gen;
+  if (!_tracegen_init(&gen, spec)) return -1;
+
+  TraceWriter* out = trace_writer_open(filename);
+  if (!out) {
+    free(gen.next);
+    return -1;
+  }
+
+  bool write;
+  for (uint64_t i = 0; i < spec->count; i++) {
+    uint64_t address = _tracegen_next(&gen, &write);
+    trace_writer_put(out, write, address);
+  }
+
+  free(gen.next);
+  return trace_writer_close(out);
+}
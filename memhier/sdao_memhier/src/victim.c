@@ -0,0 +1,78 @@
+#include <stdlib.h>
+#include "victim.h"
+#include "snapshot.h"
+#include "tagmatch.h"
+
+VictimCache* victim_new(const size_t entries) {
+  VictimCache* victim = calloc(1, sizeof(VictimCache));
+  victim->entries = entries;
+  victim->lines = calloc(entries, sizeof(uint32_t));
+  victim->replacer = replacer_new(REPLACE_LRU, 1, entries);
+
+  return victim;
+}
+
+void victim_free(VictimCache* victim) {
+  replacer_free(victim->replacer);
+  free(victim->lines);
+  free(victim);
+}
+
+void victim_reset(VictimCache* victim) {
+  victim->valid = victim->dirty = 0;
+  replacer_reset(victim->replacer);
+}
+
+bool victim_save(const VictimCache* victim, FILE* f) {
+  return snapshot_write(f, victim->lines, sizeof(uint32_t) * victim->entries)
+    && snapshot_write(f, &victim->valid, sizeof(victim->valid))
+    && snapshot_write(f, &victim->dirty, sizeof(victim->dirty))
+    && replacer_save(victim->replacer, f);
+}
+
+// valid and dirty can only have the bits of entries there are
+bool victim_load(VictimCache* victim, FILE* f) {
+  const uint32_t entries = (uint32_t) ~(~0ull << victim->entries);
+
+  return snapshot_read(f, victim->lines, sizeof(uint32_t) * victim->entries)
+    && snapshot_read(f, &victim->valid, sizeof(victim->valid))
+    && snapshot_read(f, &victim->dirty, sizeof(victim->dirty))
+    && !((victim->valid | victim->dirty) & ~entries)
+    && replacer_load(victim->replacer, f);
+}
+
+bool victim_take(VictimCache* victim, const uint32_t line, bool* dirty) {
+  uint32_t hits = tag_match(victim->lines, victim->entries, line) & victim->valid;
+  if (!hits) return false;
+
+  uint32_t bit = hits & -hits;
+  *dirty = victim->dirty & bit;
+  victim->valid &= ~bit;
+  victim->dirty &= ~bit;
+  return true;
+}
+
+bool victim_holds(const VictimCache* victim, const uint32_t line) {
+  return tag_match(victim->lines, victim->entries, line) & victim->valid;
+}
+
+bool victim_insert(VictimCache* victim, const uint32_t line, const bool dirty, uint32_t* displaced, bool* displaced_dirty) {
+  size_t entry;
+  bool full = !replacer_find_invalid(victim->replacer, 0, victim->valid, &entry);
+
+  if (full) {
+    entry = replacer_victim(victim->replacer, 0);
+    *displaced = victim->lines[entry];
+    *displaced_dirty = victim->dirty & (1u << entry);
+  }
+
+  victim->lines[entry] = line;
+  victim->valid |= 1u << entry;
+  if (dirty)
+    victim->dirty |= 1u << entry;
+  else
+    victim->dirty &= ~(1u << entry);
+  replacer_fill(victim->replacer, 0, entry);
+
+  return full;
+}
@@ -0,0 +1,27 @@
+#include <stdlib.h>
+#include "writer.h"
+
+Writer* writer_new(FILE* f) {
+  Writer* writer = malloc(sizeof(Writer));
+  writer->f = f;
+  writer->failed = false;
+  writer->len = 0;
+
+  return writer;
+}
+
+// hands everything buffered so far to stdio
+void writer_flush(Writer* writer) {
+  if (fwrite(writer->buf, 1, writer->len, writer->f) != writer->len)
+    writer->failed = true;
+  writer->len = 0;
+}
+
+bool writer_free(Writer* writer) {
+  writer_flush(writer);
+  bool ok = !writer->failed;
+  free(writer);
+
+  if (!ok) perror("Failed to write the rows");
+  return ok;
+}